@@ -0,0 +1,85 @@
+// Compares the search layouts of search.h with std::lower_bound on a large sorted array
+// Build: g++ -std=c++17 -O2 -mavx2 search.cpp
+// Usage: search [number of keys, default 1e7] [number of queries, default 1e6]
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "search.h"
+
+// Runs lookup and prints ns per query; returns the answers
+template <typename Lookup>
+std::vector<size_t> timed(const std::string &name, size_t queries, Lookup lookup)
+{
+  auto start = std::chrono::steady_clock::now();
+  std::vector<size_t> answers = lookup();
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / queries;
+  std::cout << name << ": " << ns << " ns/query" << std::endl;
+  return answers;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t n = argc > 1 ? static_cast<size_t>(std::stod(argv[1])) : 10000000;
+  size_t m = argc > 2 ? static_cast<size_t>(std::stod(argv[2])) : 1000000;
+
+  // Sorted keys with gaps and duplicates, and queries that hit and miss
+  std::mt19937 rng(42);
+  std::vector<int> sorted(n);
+  for (auto &key : sorted)
+    key = rng() % (4 * n + 1);
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<int> queries(m);
+  for (auto &query : queries)
+    query = rng() % (4 * n + 2);
+
+  EytzingerArray<int> eytzinger(sorted);
+  STree<int> stree(sorted);
+
+  auto expected = timed("std::lower_bound", m, [&] {
+    std::vector<size_t> out;
+    for (int q : queries)
+      out.push_back(std::lower_bound(sorted.begin(), sorted.end(), q) - sorted.begin());
+    return out;
+  });
+
+  std::vector<std::vector<size_t>> results;
+  results.push_back(timed("branchless", m, [&] {
+    std::vector<size_t> out;
+    for (int q : queries)
+      out.push_back(branchlessLowerBound(sorted, q));
+    return out;
+  }));
+  results.push_back(timed("branchless, batched", m, [&] {
+    std::vector<size_t> out(m);
+    branchlessLowerBound(sorted, queries.data(), m, out.data());
+    return out;
+  }));
+  results.push_back(timed("Eytzinger", m, [&] {
+    std::vector<size_t> out;
+    for (int q : queries)
+      out.push_back(eytzinger.lowerBound(q));
+    return out;
+  }));
+  results.push_back(timed("Eytzinger, batched", m, [&] { return eytzinger.lowerBound(queries); }));
+  results.push_back(timed("S-tree", m, [&] {
+    std::vector<size_t> out;
+    for (int q : queries)
+      out.push_back(stree.lowerBound(q));
+    return out;
+  }));
+  results.push_back(timed("S-tree, batched", m, [&] { return stree.lowerBound(queries); }));
+
+  for (auto &result : results)
+  {
+    if (result != expected)
+    {
+      std::cout << "Wrong answers" << std::endl;
+      return 1;
+    }
+  }
+  std::cout << "All layouts agree" << std::endl;
+  return 0;
+}
@@ -0,0 +1,333 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Searching large sorted arrays. A plain binary search waits on one cache miss
+// per level, and the branch on each comparison goes either way at random. Here:
+// - branchlessLowerBound: binary search with a conditional move instead of a
+//   branch, prefetching both possible next probes
+// - EytzingerArray: the keys in breadth-first order of the implicit search tree,
+//   so the next levels of a search share cache lines and can be prefetched
+// - STree: a static B-tree whose nodes are one cache line of keys, searched with
+//   SIMD comparisons (AVX2, ints) or a branchless scan
+// Every lowerBound returns the index in the sorted input of the first key not
+// less than the query, or the number of keys if there is none. The batched
+// overloads advance SEARCH_BATCH searches in lockstep, so their cache misses
+// overlap instead of following one another.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+const size_t CACHE_LINE = 64;
+const size_t SEARCH_BATCH = 16; // searches interleaved by the batched lookups
+
+// Cache-line aligned array of trivially copyable values
+template <typename T>
+struct AlignedArray
+{
+  static_assert(std::is_trivially_copyable<T>::value, "aligned arrays hold trivially copyable values");
+
+  std::unique_ptr<T[], decltype(&std::free)> data{nullptr, &std::free};
+
+  explicit AlignedArray(size_t n)
+  {
+    size_t bytes = (std::max<size_t>(n, 1) * sizeof(T) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    data.reset(static_cast<T *>(std::aligned_alloc(CACHE_LINE, bytes)));
+    if (!data)
+    {
+      throw std::bad_alloc();
+    }
+  }
+
+  T &operator[](size_t i) { return data[i]; }
+  const T &operator[](size_t i) const { return data[i]; }
+};
+
+// Index of the first of the sorted keys a[0, n) not less than key
+template <typename T, typename Compare = std::less<T>>
+size_t branchlessLowerBound(const T *a, size_t n, const T &key, Compare comp = Compare())
+{
+  const T *base = a;
+  while (n > 1)
+  {
+    size_t half = n / 2;
+    // The next probe is the middle of one of the two halves; fetch both
+    __builtin_prefetch(base + half / 2);
+    __builtin_prefetch(base + half + half / 2);
+    base = comp(base[half - 1], key) ? base + half : base;
+    n -= half;
+  }
+  return (base - a) + (n == 1 && comp(*base, key));
+}
+
+template <typename T, typename Compare = std::less<T>>
+size_t branchlessLowerBound(const std::vector<T> &sorted, const T &key, Compare comp = Compare())
+{
+  return branchlessLowerBound(sorted.data(), sorted.size(), key, comp);
+}
+
+// Batched branchless search: searches on the same array take the same number
+// of steps, so a batch moves through the levels together
+template <typename T, typename Compare = std::less<T>>
+void branchlessLowerBound(const std::vector<T> &sorted, const T *keys, size_t count, size_t *out,
+                          Compare comp = Compare())
+{
+  const T *a = sorted.data();
+  for (size_t start = 0; start < count; start += SEARCH_BATCH)
+  {
+    size_t batch = std::min(SEARCH_BATCH, count - start);
+    const T *base[SEARCH_BATCH];
+    std::fill(base, base + batch, a);
+    size_t n = sorted.size();
+    while (n > 1)
+    {
+      size_t half = n / 2;
+      for (size_t j = 0; j < batch; j++)
+      {
+        base[j] = comp(base[j][half - 1], keys[start + j]) ? base[j] + half : base[j];
+        __builtin_prefetch(base[j] + (n - half) / 2);
+      }
+      n -= half;
+    }
+    for (size_t j = 0; j < batch; j++)
+      out[start + j] = (base[j] - a) + (n == 1 && comp(*base[j], keys[start + j]));
+  }
+}
+
+// Sorted keys in Eytzinger (breadth-first) order: node k has children 2k and
+// 2k + 1, slot 0 is unused. The 16 great-great-grandchildren of a node are
+// adjacent, so a search prefetches the cache line it needs four levels ahead.
+template <typename T, typename Compare = std::less<T>>
+class EytzingerArray
+{
+public:
+  explicit EytzingerArray(const std::vector<T> &sorted, Compare comp = Compare())
+      : n(sorted.size()), keys(sorted.size() + 1), positions(sorted.size() + 1), comp(comp)
+  {
+    if (n >= UINT32_MAX)
+    {
+      throw std::runtime_error("EytzingerArray holds fewer than 2^32 keys");
+    }
+    size_t next = 0;
+    build(sorted, next, 1);
+    positions[0] = static_cast<uint32_t>(n); // where a search that never went left ends
+  }
+
+  size_t size() const
+  {
+    return n;
+  }
+
+  size_t lowerBound(const T &key) const
+  {
+    size_t k = 1;
+    while (k <= n)
+    {
+      __builtin_prefetch(&keys[0] + k * PREFETCH_STRIDE);
+      k = 2 * k + comp(keys[k], key);
+    }
+    return positions[finish(k)];
+  }
+
+  // Batched lookups: the searches of a batch go down the tree level by level
+  void lowerBound(const T *queries, size_t count, size_t *out) const
+  {
+    for (size_t start = 0; start < count; start += SEARCH_BATCH)
+    {
+      size_t batch = std::min(SEARCH_BATCH, count - start);
+      size_t k[SEARCH_BATCH];
+      std::fill(k, k + batch, 1);
+      for (bool active = n > 0; active;)
+      {
+        active = false;
+        for (size_t j = 0; j < batch; j++)
+        {
+          if (k[j] <= n)
+          {
+            __builtin_prefetch(&keys[0] + k[j] * PREFETCH_STRIDE);
+            k[j] = 2 * k[j] + comp(keys[k[j]], queries[start + j]);
+            active = true;
+          }
+        }
+      }
+      for (size_t j = 0; j < batch; j++)
+        out[start + j] = positions[finish(k[j])];
+    }
+  }
+
+  std::vector<size_t> lowerBound(const std::vector<T> &queries) const
+  {
+    std::vector<size_t> out(queries.size());
+    lowerBound(queries.data(), queries.size(), out.data());
+    return out;
+  }
+
+private:
+  // Keys per cache line; a node's descendants that many levels down share a line
+  static constexpr size_t PREFETCH_STRIDE = std::max<size_t>(CACHE_LINE / sizeof(T), 1);
+
+  size_t n;
+  AlignedArray<T> keys;
+  AlignedArray<uint32_t> positions; // index in the sorted input of each node
+  Compare comp;
+
+  // In-order traversal of the implicit tree hands out the sorted keys
+  void build(const std::vector<T> &sorted, size_t &next, size_t k)
+  {
+    if (k > n)
+      return;
+    build(sorted, next, 2 * k);
+    positions[k] = static_cast<uint32_t>(next);
+    keys[k] = sorted[next++];
+    build(sorted, next, 2 * k + 1);
+  }
+
+  // The search went right (key too small) after its last left turn at the
+  // answer: dropping the trailing right turns and that left turn recovers it
+  static size_t finish(size_t k)
+  {
+    return k >> __builtin_ffsll(~k);
+  }
+};
+
+// Static B-tree (S-tree): every node is B sorted keys filling one cache line,
+// and node k has children k * (B + 1) + 1 .. k * (B + 1) + B + 1. A search reads
+// one line per level, log_(B+1) n levels instead of log_2 n, and finds its
+// slot in a node by counting the keys less than the query without branches.
+// With AVX2 and ascending ints, a node is compared in two instructions.
+template <typename T, typename Compare = std::less<T>>
+class STree
+{
+public:
+  static constexpr size_t B = std::max<size_t>(CACHE_LINE / sizeof(T), 2); // keys per node
+
+  explicit STree(const std::vector<T> &sorted, Compare comp = Compare())
+      : n(sorted.size()), nodes((sorted.size() + B - 1) / B), keys(std::max<size_t>(nodes, 1) * B),
+        positions(std::max<size_t>(nodes, 1) * B), comp(comp)
+  {
+    if (n >= UINT32_MAX)
+    {
+      throw std::runtime_error("STree holds fewer than 2^32 keys");
+    }
+    size_t next = 0;
+    build(sorted, next, 0);
+  }
+
+  size_t size() const
+  {
+    return n;
+  }
+
+  size_t lowerBound(const T &key) const
+  {
+    size_t answer = n;
+    for (size_t k = 0; k < nodes;)
+    {
+      size_t i = rank(k, key);
+      if (i < B)
+        answer = positions[k * B + i]; // children hold smaller keys and may improve it
+      k = child(k, i);
+    }
+    return answer;
+  }
+
+  // Batched lookups: all searches of a batch read a node per level, then the
+  // next nodes are prefetched together
+  void lowerBound(const T *queries, size_t count, size_t *out) const
+  {
+    for (size_t start = 0; start < count; start += SEARCH_BATCH)
+    {
+      size_t batch = std::min(SEARCH_BATCH, count - start);
+      size_t k[SEARCH_BATCH];
+      std::fill(k, k + batch, 0);
+      std::fill(out + start, out + start + batch, n);
+      for (bool active = nodes > 0; active;)
+      {
+        active = false;
+        for (size_t j = 0; j < batch; j++)
+        {
+          if (k[j] < nodes)
+          {
+            size_t i = rank(k[j], queries[start + j]);
+            if (i < B)
+              out[start + j] = positions[k[j] * B + i];
+            k[j] = child(k[j], i);
+            if (k[j] < nodes)
+              __builtin_prefetch(&keys[k[j] * B]);
+            active = true;
+          }
+        }
+      }
+    }
+  }
+
+  std::vector<size_t> lowerBound(const std::vector<T> &queries) const
+  {
+    std::vector<size_t> out(queries.size());
+    lowerBound(queries.data(), queries.size(), out.data());
+    return out;
+  }
+
+private:
+  size_t n, nodes;
+  AlignedArray<T> keys;             // node-major, B keys per node
+  AlignedArray<uint32_t> positions; // index in the sorted input of each key
+  Compare comp;
+
+  static size_t child(size_t k, size_t i)
+  {
+    return k * (B + 1) + i + 1;
+  }
+
+  // In-order traversal of the tree hands out the sorted keys. Slots past the
+  // last key repeat it; they come after every real key in order, so a search
+  // only ends on one when the real keys are all less than the query.
+  void build(const std::vector<T> &sorted, size_t &next, size_t k)
+  {
+    if (k >= nodes)
+      return;
+    for (size_t i = 0; i < B; i++)
+    {
+      build(sorted, next, child(k, i));
+      keys[k * B + i] = next < n ? sorted[next] : sorted[n - 1];
+      positions[k * B + i] = static_cast<uint32_t>(std::min(next, n));
+      next++;
+    }
+    build(sorted, next, child(k, B));
+  }
+
+  // Number of keys of node k less than key; the keys of a node are sorted
+  size_t rank(size_t k, const T &key) const
+  {
+    const T *node = &keys[k * B];
+#ifdef __AVX2__
+    constexpr bool ascendingInts = std::is_same<T, int>::value &&
+                                   (std::is_same<Compare, std::less<int>>::value || std::is_same<Compare, std::less<>>::value);
+    if constexpr (ascendingInts && B == 16)
+    {
+      __m256i x = _mm256_set1_epi32(key);
+      __m256i less0 = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i *>(node)));
+      __m256i less1 = _mm256_cmpgt_epi32(x, _mm256_load_si256(reinterpret_cast<const __m256i *>(node + 8)));
+      unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(less0)) |
+                      (_mm256_movemask_ps(_mm256_castsi256_ps(less1)) << 8);
+      return __builtin_popcount(mask);
+    }
+#endif
+    size_t count = 0;
+    for (size_t i = 0; i < B; i++)
+      count += comp(node[i], key);
+    return count;
+  }
+};
+
+#endif
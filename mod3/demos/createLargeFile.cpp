@@ -1,40 +1,333 @@
-#include <fstream>
 #include <iostream>
-#include <cstdlib> // For rand() and srand()
-#include <ctime>   // For time()
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "recordio.h"
 
-int main() {
-  // Create and open a binary file
-  std::ofstream output("largedata.dat", std::ios::binary);
+// Generates a binary file of ints for the external sort.
+// Build: g++ -std=c++17 -O2 -pthread createLargeFile.cpp
+// Usage: createLargeFile [--count=N | --size=100G] [--distribution=uniform] [--range=N]
+//                        [--seed=N] [--threads=N] [--zipf=S] [--noise=F] [--distinct=N] [file]
+// Distributions: uniform, zipf, sorted, reverse, nearly-sorted, duplicates.
+// The file is cut into chunks that threads generate and write independently;
+// each chunk has its own generator seeded from (seed, chunk), so the same
+// seed gives the same file for any number of threads.
 
-  // Seed the random number generator
-  srand(time(0));
+const long long CHUNK_RECORDS = 1 << 20; // 4 MiB of ints per chunk
 
-  // Write random numbers to the file
-  for (int i = 0; i < 20000; i++) {
-    int number = rand() % 1000000;
-    if(i < 100)
-      std::cout << number << " ";
-    output.write(reinterpret_cast<const char*>(&number), sizeof(number));
+// Options of the generator
+struct GeneratorOptions
+{
+  long long count = 20000;              // records to write
+  std::string distribution = "uniform";
+  long long range = 1000000;            // values are in [0, range)
+  unsigned long long seed = 1;
+  int threads = std::max(1u, std::thread::hardware_concurrency());
+  double zipfExponent = 1.1;            // zipf: P(k) ~ 1 / k^s
+  double noise = 0.01;                  // nearly-sorted: share of records replaced by random ones
+  long long distinct = 100;             // duplicates: number of different values
+};
+
+// SplitMix64: turns a seed into well-mixed 64-bit states
+uint64_t splitMix64(uint64_t &state)
+{
+  uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// xoshiro256** by Blackman and Vigna: fast, 256 bits of state, passes BigCrush
+class Xoshiro256
+{
+public:
+  Xoshiro256(uint64_t seed)
+  {
+    for (auto &word : s)
+      word = splitMix64(seed);
+  }
+
+  uint64_t next()
+  {
+    uint64_t result = rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  // Uniform in [0, bound) by multiply-shift (Lemire), without a division
+  uint64_t below(uint64_t bound)
+  {
+    return static_cast<uint64_t>((static_cast<unsigned __int128>(next()) * bound) >> 64);
+  }
+
+  // Uniform in [0, 1)
+  double uniform()
+  {
+    return (next() >> 11) * 0x1.0p-53;
+  }
+
+private:
+  uint64_t s[4];
+
+  static uint64_t rotl(uint64_t x, int k)
+  {
+    return (x << k) | (x >> (64 - k));
   }
-  std::cout << std::endl;
+};
 
-  // Close the file
-  output.close();
+// Zipf distribution on 1..n with exponent s > 0 by rejection-inversion
+// (Hörmann and Derflinger): O(1) per sample without a table of n probabilities
+class ZipfSampler
+{
+public:
+  ZipfSampler(long long n, double s) : n(n), s(s)
+  {
+    if (n < 1 || s <= 0)
+    {
+      throw std::runtime_error("Zipf needs at least one value and a positive exponent");
+    }
+    hIntegralX1 = hIntegral(1.5) - 1;
+    hIntegralN = hIntegral(n + 0.5);
+    threshold = 2 - hIntegralInverse(hIntegral(2.5) - h(2));
+  }
+
+  long long operator()(Xoshiro256 &rng) const
+  {
+    while (true)
+    {
+      double u = hIntegralN + rng.uniform() * (hIntegralX1 - hIntegralN);
+      double x = hIntegralInverse(u);
+      long long k = std::min(std::max(static_cast<long long>(x + 0.5), 1LL), n);
+      if (k - x <= threshold || u >= hIntegral(k + 0.5) - h(k))
+        return k;
+    }
+  }
 
-  // Open the file for reading
-  std::ifstream input("largedata.dat", std::ios::binary);
+private:
+  long long n;
+  double s, hIntegralX1, hIntegralN, threshold;
 
-  // Read and display the first 100 numbers
-  for (int i = 0; i < 100; i++) {
-    int number;
-    input.read(reinterpret_cast<char*>(&number), sizeof(number));
-    std::cout << number << " ";
+  double h(double x) const
+  {
+    return std::exp(-s * std::log(x));
   }
-  std::cout << std::endl;
 
-  // Close the file
-  input.close();
+  // Integral of h, and its inverse
+  double hIntegral(double x) const
+  {
+    double logX = std::log(x);
+    return expm1OverX((1 - s) * logX) * logX;
+  }
 
+  double hIntegralInverse(double x) const
+  {
+    double t = std::max(x * (1 - s), -1.0);
+    return std::exp(log1pOverX(t) * x);
+  }
+
+  // log(1 + x) / x and (e^x - 1) / x, accurate near 0
+  static double log1pOverX(double x)
+  {
+    return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x / 2;
+  }
+
+  static double expm1OverX(double x)
+  {
+    return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x / 2;
+  }
+};
+
+// Function prototypes
+GeneratorOptions parseOptions(int argc, char *argv[], std::string &filename);
+void generateChunk(const GeneratorOptions &options, long long chunk, std::vector<int> &values);
+void generateFile(const std::string &filename, const GeneratorOptions &options);
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    std::string filename = "largedata.dat";
+    GeneratorOptions options = parseOptions(argc, argv, filename);
+    generateFile(filename, options);
+
+    // Read and display the first 100 numbers
+    RecordReader<int> input(filename);
+    std::vector<int> numbers(100);
+    numbers.resize(input.read(numbers.data(), numbers.size()));
+    for (int number : numbers)
+    {
+      std::cout << number << " ";
+    }
+    std::cout << std::endl;
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
   return 0;
 }
+
+// Writes options.count records; threads take the next chunk until none is left
+void generateFile(const std::string &filename, const GeneratorOptions &options)
+{
+  RecordWriter<int>(filename).close(); // create or empty the file
+
+  long long chunks = (options.count + CHUNK_RECORDS - 1) / CHUNK_RECORDS;
+  std::atomic<long long> nextChunk{0};
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> errors(options.threads);
+  for (int t = 0; t < options.threads; t++)
+  {
+    threads.emplace_back([&, t] {
+      try
+      {
+        std::vector<int> values;
+        for (long long chunk; (chunk = nextChunk++) < chunks;)
+        {
+          generateChunk(options, chunk, values);
+          RecordWriter<int> output(filename, WriteMode::Update, chunk * CHUNK_RECORDS);
+          output.write(values.data(), values.size());
+          output.close();
+        }
+      }
+      catch (...)
+      {
+        errors[t] = std::current_exception();
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &error : errors)
+  {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+// Fills values with the records of one chunk
+void generateChunk(const GeneratorOptions &options, long long chunk, std::vector<int> &values)
+{
+  long long first = chunk * CHUNK_RECORDS;
+  values.resize(std::min(CHUNK_RECORDS, options.count - first));
+  uint64_t seed = options.seed;
+  Xoshiro256 rng(splitMix64(seed) ^ static_cast<uint64_t>(chunk) * 0xd1342543de82ef95ULL);
+  const uint64_t range = options.range;
+  // sorted and reverse spread the records evenly over the range
+  const double step = double(options.range) / std::max(options.count, 1LL);
+
+  if (options.distribution == "uniform")
+  {
+    for (auto &value : values)
+      value = static_cast<int>(rng.below(range));
+  }
+  else if (options.distribution == "zipf")
+  {
+    // Value k - 1 has probability ~ 1 / k^s: 0 is the most frequent
+    ZipfSampler zipf(options.range, options.zipfExponent);
+    for (auto &value : values)
+      value = static_cast<int>(zipf(rng) - 1);
+  }
+  else if (options.distribution == "sorted" || options.distribution == "nearly-sorted")
+  {
+    for (size_t i = 0; i < values.size(); i++)
+      values[i] = static_cast<int>((first + i) * step);
+    if (options.distribution == "nearly-sorted")
+    {
+      for (auto &value : values)
+      {
+        if (rng.uniform() < options.noise)
+          value = static_cast<int>(rng.below(range));
+      }
+    }
+  }
+  else if (options.distribution == "reverse")
+  {
+    for (size_t i = 0; i < values.size(); i++)
+      values[i] = static_cast<int>((options.count - 1 - (first + i)) * step);
+  }
+  else if (options.distribution == "duplicates")
+  {
+    // distinct values spread over the range
+    uint64_t distinct = std::min<uint64_t>(options.distinct, range), gap = range / distinct;
+    for (auto &value : values)
+      value = static_cast<int>(rng.below(distinct) * gap);
+  }
+  else
+  {
+    throw std::runtime_error("Unknown distribution " + options.distribution);
+  }
+}
+
+// Parses a count such as 1000000, 1e9 or 2.5e8
+long long parseCount(const std::string &text)
+{
+  return static_cast<long long>(std::stod(text));
+}
+
+// Parses a size in bytes with an optional K, M, G or T suffix (powers of 1024)
+long long parseBytes(const std::string &text)
+{
+  size_t end;
+  double value = std::stod(text, &end);
+  std::string suffix = text.substr(end);
+  const std::string units = "KMGT";
+  if (!suffix.empty())
+  {
+    size_t unit = units.find(std::toupper(suffix[0]));
+    if (unit == std::string::npos)
+    {
+      throw std::runtime_error("Unknown size suffix in " + text);
+    }
+    value *= std::pow(1024.0, unit + 1);
+  }
+  return static_cast<long long>(value);
+}
+
+GeneratorOptions parseOptions(int argc, char *argv[], std::string &filename)
+{
+  GeneratorOptions options;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg.rfind("--count=", 0) == 0)
+      options.count = parseCount(arg.substr(8));
+    else if (arg.rfind("--size=", 0) == 0)
+      options.count = parseBytes(arg.substr(7)) / sizeof(int);
+    else if (arg.rfind("--distribution=", 0) == 0)
+      options.distribution = arg.substr(15);
+    else if (arg.rfind("--range=", 0) == 0)
+      options.range = std::min(parseCount(arg.substr(8)), 1LL << 31);
+    else if (arg.rfind("--seed=", 0) == 0)
+      options.seed = std::stoull(arg.substr(7));
+    else if (arg.rfind("--threads=", 0) == 0)
+      options.threads = std::max(1, std::stoi(arg.substr(10)));
+    else if (arg.rfind("--zipf=", 0) == 0)
+      options.zipfExponent = std::stod(arg.substr(7));
+    else if (arg.rfind("--noise=", 0) == 0)
+      options.noise = std::stod(arg.substr(8));
+    else if (arg.rfind("--distinct=", 0) == 0)
+      options.distinct = std::max(1LL, parseCount(arg.substr(11)));
+    else
+      filename = arg;
+  }
+  if (options.count < 0 || options.range < 1)
+  {
+    throw std::runtime_error("The count must not be negative and the range must be positive");
+  }
+  return options;
+}
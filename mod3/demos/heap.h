@@ -0,0 +1,402 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+// d-ary heaps stored in a vector: the children of node i are Arity * i + 1 .. Arity * i + Arity.
+// With Arity = 4 or 8 the children of a node usually share a cache line, and the tree
+// is half or a third as deep as a binary heap.
+const size_t DEFAULT_HEAP_ARITY = 4;
+
+// The Heap class
+// comp(a, b) tells that a has a lower priority than b; the default gives a max heap
+template <typename T, typename Compare = std::less<T>, size_t Arity = DEFAULT_HEAP_ARITY>
+class Heap
+{
+  static_assert(Arity >= 2, "a heap node needs at least two children");
+
+public:
+  // Create an empty heap
+  Heap(Compare comp = Compare()) : comp(comp) {}
+
+  // Create a heap from a vector in O(n) (Floyd's heapify); pass an rvalue to avoid the copy
+  Heap(std::vector<T> vec, Compare comp = Compare()) : data(std::move(vec)), comp(comp)
+  {
+    heapify();
+  }
+
+  // Insert an element into the heap
+  void insert(T value)
+  {
+    // Add the new element to the end of the vector
+    data.push_back(std::move(value));
+    // Move the new element up to maintain the heap property
+    siftUp(data.size() - 1);
+  }
+
+  // Extract the maximum element from the heap
+  T extractMax()
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    T maxElement = std::move(data[0]);
+    // The last element fills the hole at the root and sinks down
+    T last = std::move(data.back());
+    data.pop_back();
+    if (!data.empty())
+    {
+      data[0] = std::move(last);
+      siftDown(0, data.size());
+    }
+    return maxElement;
+  }
+
+  // Get the maximum element
+  const T &getMax() const
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    return data[0];
+  }
+
+  // Replace the maximum element with value; cheaper than extractMax followed by insert
+  T replaceMax(T value)
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    T maxElement = std::move(data[0]);
+    data[0] = std::move(value);
+    siftDown(0, data.size());
+    return maxElement;
+  }
+
+  // Sort the elements in place, lowest priority first, and hand them over; the heap is left empty
+  std::vector<T> extractSorted()
+  {
+    for (size_t end = data.size(); end > 1; end--)
+    {
+      T maxElement = std::move(data[0]);
+      data[0] = std::move(data[end - 1]);
+      siftDown(0, end - 1);
+      data[end - 1] = std::move(maxElement);
+    }
+    return std::move(data);
+  }
+
+  // Check if the heap is empty
+  bool isEmpty() const
+  {
+    return data.empty();
+  }
+
+  // Get size
+  size_t getSize() const
+  {
+    return data.size();
+  }
+
+  // Print heap
+  void print() const
+  {
+    for (auto &e : data)
+    {
+      std::cout << e << " ";
+    }
+    std::cout << std::endl;
+  }
+
+private:
+  std::vector<T> data;
+  Compare comp;
+
+  // Sift down every inner node, the last one first
+  void heapify()
+  {
+    if (data.size() < 2)
+      return;
+    for (size_t i = (data.size() - 2) / Arity + 1; i-- > 0;)
+    {
+      siftDown(i, data.size());
+    }
+  }
+
+  // Move an element up the heap to maintain the heap property.
+  // The element is held aside and its ancestors move down into the hole.
+  void siftUp(size_t index)
+  {
+    T value = std::move(data[index]);
+    while (index > 0)
+    {
+      size_t parentIndex = (index - 1) / Arity;
+      if (!comp(data[parentIndex], value))
+      {
+        // The heap property is satisfied
+        break;
+      }
+      data[index] = std::move(data[parentIndex]);
+      index = parentIndex;
+    }
+    data[index] = std::move(value);
+  }
+
+  // Move an element down the first size elements of the heap to maintain the heap property
+  void siftDown(size_t index, size_t size)
+  {
+    T value = std::move(data[index]);
+    while (true)
+    {
+      size_t firstChild = Arity * index + 1;
+      if (firstChild >= size)
+        break;
+
+      // Find the largest of the children
+      size_t lastChild = std::min(firstChild + Arity, size);
+      size_t largestChild = firstChild;
+      for (size_t child = firstChild + 1; child < lastChild; child++)
+      {
+        if (comp(data[largestChild], data[child]))
+          largestChild = child;
+      }
+
+      if (!comp(value, data[largestChild]))
+      {
+        // The heap property is satisfied
+        break;
+      }
+      data[index] = std::move(data[largestChild]);
+      index = largestChild;
+    }
+    data[index] = std::move(value);
+  }
+};
+
+// A d-ary heap whose elements can be found again through handles, to change their
+// priority (decrease-key) or remove them. A handle stays valid until its element
+// leaves the heap; afterwards it may be given to a new element.
+template <typename T, typename Compare = std::less<T>, size_t Arity = DEFAULT_HEAP_ARITY>
+class AddressableHeap
+{
+  static_assert(Arity >= 2, "a heap node needs at least two children");
+
+public:
+  using Handle = size_t;
+
+  // Create an empty heap
+  AddressableHeap(Compare comp = Compare()) : comp(comp) {}
+
+  // Create a heap from a vector in O(n); element i gets handle i
+  AddressableHeap(std::vector<T> vec, Compare comp = Compare()) : comp(comp)
+  {
+    data.reserve(vec.size());
+    positions.resize(vec.size());
+    for (size_t i = 0; i < vec.size(); i++)
+    {
+      data.push_back({std::move(vec[i]), i});
+      positions[i] = i;
+    }
+    if (data.size() > 1)
+    {
+      for (size_t i = (data.size() - 2) / Arity + 1; i-- > 0;)
+      {
+        siftDown(i);
+      }
+    }
+  }
+
+  // Insert an element and return its handle
+  Handle insert(T value)
+  {
+    Handle handle;
+    if (freeHandles.empty())
+    {
+      handle = positions.size();
+      positions.push_back(data.size());
+    }
+    else
+    {
+      handle = freeHandles.back();
+      freeHandles.pop_back();
+      positions[handle] = data.size();
+    }
+    data.push_back({std::move(value), handle});
+    siftUp(data.size() - 1);
+    return handle;
+  }
+
+  // Extract the maximum element from the heap
+  T extractMax()
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    return removeAt(0);
+  }
+
+  // Get the maximum element
+  const T &getMax() const
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    return data[0].value;
+  }
+
+  // Get the handle of the maximum element
+  Handle getMaxHandle() const
+  {
+    if (isEmpty())
+    {
+      throw std::runtime_error("Heap is empty");
+    }
+    return data[0].handle;
+  }
+
+  // Check if a handle refers to an element of the heap
+  bool contains(Handle handle) const
+  {
+    return handle < positions.size() && positions[handle] != NOT_IN_HEAP;
+  }
+
+  // Get the element of a handle
+  const T &get(Handle handle) const
+  {
+    return data[position(handle)].value;
+  }
+
+  // Give the element of a handle a new value, raising or lowering its priority
+  void update(Handle handle, T value)
+  {
+    size_t index = position(handle);
+    bool raised = comp(data[index].value, value);
+    data[index].value = std::move(value);
+    if (raised)
+      siftUp(index);
+    else
+      siftDown(index);
+  }
+
+  // Remove the element of a handle from the heap and return it
+  T erase(Handle handle)
+  {
+    return removeAt(position(handle));
+  }
+
+  // Check if the heap is empty
+  bool isEmpty() const
+  {
+    return data.empty();
+  }
+
+  // Get size
+  size_t getSize() const
+  {
+    return data.size();
+  }
+
+private:
+  static constexpr size_t NOT_IN_HEAP = SIZE_MAX;
+
+  // Elements are kept next to their handles, so sifting touches a single array
+  struct Entry
+  {
+    T value;
+    Handle handle;
+  };
+
+  std::vector<Entry> data;
+  std::vector<size_t> positions; // index in data of each handle
+  std::vector<Handle> freeHandles;
+  Compare comp;
+
+  size_t position(Handle handle) const
+  {
+    if (!contains(handle))
+    {
+      throw std::runtime_error("Handle is not in the heap");
+    }
+    return positions[handle];
+  }
+
+  // Remove the element at index; the last element takes its place and moves up or down
+  T removeAt(size_t index)
+  {
+    Entry removed = std::move(data[index]);
+    positions[removed.handle] = NOT_IN_HEAP;
+    freeHandles.push_back(removed.handle);
+
+    Entry last = std::move(data.back());
+    data.pop_back();
+    if (index < data.size())
+    {
+      bool raised = comp(removed.value, last.value);
+      data[index] = std::move(last);
+      positions[data[index].handle] = index;
+      if (raised)
+        siftUp(index);
+      else
+        siftDown(index);
+    }
+    return std::move(removed.value);
+  }
+
+  // Put an entry at index and record its new position
+  void place(size_t index, Entry entry)
+  {
+    positions[entry.handle] = index;
+    data[index] = std::move(entry);
+  }
+
+  void siftUp(size_t index)
+  {
+    Entry entry = std::move(data[index]);
+    while (index > 0)
+    {
+      size_t parentIndex = (index - 1) / Arity;
+      if (!comp(data[parentIndex].value, entry.value))
+        break;
+      place(index, std::move(data[parentIndex]));
+      index = parentIndex;
+    }
+    place(index, std::move(entry));
+  }
+
+  void siftDown(size_t index)
+  {
+    Entry entry = std::move(data[index]);
+    while (true)
+    {
+      size_t firstChild = Arity * index + 1;
+      if (firstChild >= data.size())
+        break;
+
+      size_t lastChild = std::min(firstChild + Arity, data.size());
+      size_t largestChild = firstChild;
+      for (size_t child = firstChild + 1; child < lastChild; child++)
+      {
+        if (comp(data[largestChild].value, data[child].value))
+          largestChild = child;
+      }
+
+      if (!comp(entry.value, data[largestChild].value))
+        break;
+      place(index, std::move(data[largestChild]));
+      index = largestChild;
+    }
+    place(index, std::move(entry));
+  }
+};
+
+#endif
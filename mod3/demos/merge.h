@@ -0,0 +1,236 @@
+#ifndef MERGE_H
+#define MERGE_H
+
+// Merging sorted sequences: a loser tree over k sources, a lazy k-way merge of
+// sorted ranges built on it, and co-ranking, which splits a two-way merge into
+// independent pieces for parallel merging.
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Loser tree (tournament tree) over k sources: picking the next smallest
+// element costs log2(k) comparisons against the stored losers.
+// Sources are pointer-like and provide current(), advance() and isEmpty().
+template <typename Source, typename Compare = std::less<>>
+class LoserTree
+{
+public:
+  LoserTree(std::vector<Source> &sources, Compare comp = Compare())
+      : sources(sources), k(sources.size()), tree(std::max<size_t>(k, 1)), comp(comp)
+  {
+    // Play the initial tournament bottom-up; leaves are nodes k..2k-1
+    std::vector<size_t> winner(2 * k);
+    for (size_t i = 0; i < k; i++)
+      winner[k + i] = i;
+    for (size_t node = k - 1; node >= 1 && node < k; node--)
+    {
+      size_t left = winner[2 * node], right = winner[2 * node + 1];
+      bool leftWins = beats(left, right);
+      winner[node] = leftWins ? left : right;
+      tree[node] = leftWins ? right : left;
+    }
+    tree[0] = k > 1 ? winner[1] : 0;
+  }
+
+  bool isEmpty() const
+  {
+    return k == 0 || sources[tree[0]]->isEmpty();
+  }
+
+  // Source holding the smallest head
+  Source &top()
+  {
+    return sources[tree[0]];
+  }
+
+  // Advances the top source and replays its path to the root
+  void pop()
+  {
+    size_t winner = tree[0];
+    sources[winner]->advance();
+    for (size_t node = (k + winner) / 2; node >= 1; node /= 2)
+    {
+      if (beats(tree[node], winner))
+        std::swap(tree[node], winner);
+    }
+    tree[0] = winner;
+  }
+
+private:
+  std::vector<Source> &sources;
+  size_t k;
+  std::vector<size_t> tree; // tree[0] is the winner, tree[1..k-1] the losers
+  Compare comp;
+
+  // Exhausted sources always lose; ties go to the lower source to keep the merge stable
+  bool beats(size_t a, size_t b) const
+  {
+    if (sources[b]->isEmpty())
+      return true;
+    if (sources[a]->isEmpty())
+      return false;
+    if (comp(sources[a]->current(), sources[b]->current()))
+      return true;
+    if (comp(sources[b]->current(), sources[a]->current()))
+      return false;
+    return a < b;
+  }
+};
+
+// Source over a sorted range [first, last). It is its own pointer, so that
+// a vector of RangeSources can feed a LoserTree.
+template <typename It>
+class RangeSource
+{
+public:
+  RangeSource(It first, It last) : first(first), last(last) {}
+
+  bool isEmpty() const
+  {
+    return first == last;
+  }
+
+  const typename std::iterator_traits<It>::value_type &current() const
+  {
+    return *first;
+  }
+
+  void advance()
+  {
+    ++first;
+  }
+
+  RangeSource *operator->()
+  {
+    return this;
+  }
+
+  const RangeSource *operator->() const
+  {
+    return this;
+  }
+
+private:
+  It first, last;
+};
+
+// Lazy, stable k-way merge of sorted ranges. The only allocations happen in
+// the constructor; each element then costs log2(k) comparisons. A KWayMerge
+// is a source itself (isEmpty, current, advance) and also has input iterators,
+// so it can feed a range-for loop or std::copy.
+template <typename It, typename Compare = std::less<>>
+class KWayMerge
+{
+public:
+  using value_type = typename std::iterator_traits<It>::value_type;
+
+  // ranges are (first, last) pairs of iterators
+  KWayMerge(const std::vector<std::pair<It, It>> &ranges, Compare comp = Compare())
+      : sources(makeSources(ranges)), tree(sources, comp)
+  {
+  }
+
+  // The tree refers to the sources, so a merge stays where it was built
+  KWayMerge(const KWayMerge &) = delete;
+  KWayMerge &operator=(const KWayMerge &) = delete;
+
+  bool isEmpty() const
+  {
+    return tree.isEmpty();
+  }
+
+  const value_type &current()
+  {
+    return tree.top()->current();
+  }
+
+  void advance()
+  {
+    tree.pop();
+  }
+
+  // Input iterator; all iterators of a merge share its position
+  class iterator
+  {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename KWayMerge::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type *;
+    using reference = const value_type &;
+
+    explicit iterator(KWayMerge *merge = nullptr) : merge(merge) {}
+
+    reference operator*() const { return merge->current(); }
+    pointer operator->() const { return &merge->current(); }
+
+    iterator &operator++()
+    {
+      merge->advance();
+      return *this;
+    }
+
+    void operator++(int) { merge->advance(); }
+
+    // Iterators compare equal when both are at the end
+    bool operator==(const iterator &other) const { return atEnd() == other.atEnd(); }
+    bool operator!=(const iterator &other) const { return !(*this == other); }
+
+  private:
+    KWayMerge *merge;
+
+    bool atEnd() const { return merge == nullptr || merge->isEmpty(); }
+  };
+
+  iterator begin() { return iterator(this); }
+  iterator end() { return iterator(); }
+
+private:
+  std::vector<RangeSource<It>> sources;
+  LoserTree<RangeSource<It>, Compare> tree;
+
+  static std::vector<RangeSource<It>> makeSources(const std::vector<std::pair<It, It>> &ranges)
+  {
+    std::vector<RangeSource<It>> sources;
+    sources.reserve(ranges.size());
+    for (auto &range : ranges)
+      sources.emplace_back(range.first, range.second);
+    return sources;
+  }
+};
+
+// The whole-container ranges of a sequence of containers, e.g. to merge sorted shards:
+// KWayMerge merge(rangesOf(shards));
+template <typename Containers>
+auto rangesOf(const Containers &containers)
+{
+  using It = decltype(std::begin(*std::begin(containers)));
+  std::vector<std::pair<It, It>> ranges;
+  for (auto &container : containers)
+    ranges.emplace_back(std::begin(container), std::end(container));
+  return ranges;
+}
+
+// Co-rank (merge path): the number i of elements that the first k elements of
+// the stable merge of a[0, na) and b[0, nb) take from a; the other k - i come
+// from b. Equal elements of a go first. O(log min(k, na)) comparisons.
+template <typename It1, typename It2, typename Compare>
+size_t coRank(size_t k, It1 a, size_t na, It2 b, size_t nb, Compare comp)
+{
+  size_t low = k > nb ? k - nb : 0, high = std::min(k, na);
+  while (low < high)
+  {
+    size_t i = low + (high - low) / 2, j = k - i;
+    // a[i] still belongs to the first k if b[j - 1] is not less than it
+    if (j > 0 && !comp(b[j - 1], a[i]))
+      low = i + 1;
+    else
+      high = i;
+  }
+  return low;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef PACKEDRUNS_H
+#define PACKEDRUNS_H
+
+// Compressed runs of ints for the external sort. A run is cut into blocks of
+// up to PACKED_BLOCK values; a block stores its first value and the gaps
+// between neighbours, bit-packed with the width of the largest gap
+// (delta + frame-of-reference). Sorted runs have small gaps, so a block takes
+// a few bits per value instead of 32. Decoding a block is a fixed-width unpack
+// without branches followed by a prefix sum, which compilers vectorize.
+// Files are sequences of 32-bit words; run offsets are in words.
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "recordio.h"
+
+const size_t PACKED_BLOCK = 128; // values per block
+
+// Largest number of words a run of length values can take
+inline long long packedWordsBound(long long length)
+{
+  return length + 2 * ((length + PACKED_BLOCK - 1) / PACKED_BLOCK);
+}
+
+// Writes runs of ints as packed blocks, starting at word offset
+class PackedRunWriter
+{
+public:
+  PackedRunWriter(const std::string &filename, WriteMode mode = WriteMode::Truncate, long long offset = 0,
+                  size_t bufferBytes = DEFAULT_IO_BUFFER_BYTES)
+      : words(filename, mode, offset, bufferBytes)
+  {
+  }
+
+  void write(int value)
+  {
+    block[count++] = value;
+    if (count == PACKED_BLOCK)
+      flushBlock();
+  }
+
+  void write(const int *values, size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+      write(values[i]);
+  }
+
+  // Ends the current block, so that a run can start here, and returns its word offset
+  long long position()
+  {
+    flushBlock();
+    return words.position();
+  }
+
+  void close()
+  {
+    flushBlock();
+    words.close();
+  }
+
+private:
+  RecordWriter<uint32_t> words;
+  int block[PACKED_BLOCK];
+  size_t count = 0;
+
+  // Block layout: first value, count | bit width << 16, then count - 1 packed gaps.
+  // Gaps are taken modulo 2^32, so even an unsorted block decodes correctly.
+  void flushBlock()
+  {
+    if (count == 0)
+      return;
+    uint32_t gaps[PACKED_BLOCK], widest = 0;
+    for (size_t i = 1; i < count; i++)
+    {
+      gaps[i - 1] = static_cast<uint32_t>(block[i]) - static_cast<uint32_t>(block[i - 1]);
+      widest |= gaps[i - 1];
+    }
+    uint32_t bits = widest == 0 ? 0 : 32 - __builtin_clz(widest);
+
+    uint32_t out[PACKED_BLOCK + 3] = {};
+    out[0] = static_cast<uint32_t>(block[0]);
+    out[1] = static_cast<uint32_t>(count) | bits << 16;
+    uint32_t *packed = out + 2;
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+      size_t bit = i * bits;
+      uint64_t shifted = static_cast<uint64_t>(gaps[i]) << (bit & 31);
+      packed[bit >> 5] |= static_cast<uint32_t>(shifted);
+      packed[(bit >> 5) + 1] |= static_cast<uint32_t>(shifted >> 32);
+    }
+    words.write(out, 2 + ((count - 1) * bits + 31) / 32);
+    count = 0;
+  }
+};
+
+// Reads a packed run of length values that starts at word offset; the same
+// interface as RecordReader, so runs merge straight from their blocks
+class PackedRunReader
+{
+public:
+  PackedRunReader(const std::string &filename, long long offset, long long length, bool useMmap = false,
+                  size_t bufferBytes = DEFAULT_IO_BUFFER_BYTES)
+      : filename(filename), words(filename, offset, packedWordsBound(length), useMmap, bufferBytes), remaining(length)
+  {
+    loadBlock();
+  }
+
+  bool isEmpty() const
+  {
+    return position == count;
+  }
+
+  const int &current() const
+  {
+    return values[position];
+  }
+
+  void advance()
+  {
+    if (++position == count)
+      loadBlock();
+  }
+
+  bool read(int &value)
+  {
+    if (isEmpty())
+      return false;
+    value = current();
+    advance();
+    return true;
+  }
+
+private:
+  std::string filename;
+  RecordReader<uint32_t> words;
+  int values[PACKED_BLOCK];
+  size_t position = 0, count = 0;
+  long long remaining; // values of the run not decoded yet
+
+  void loadBlock()
+  {
+    position = 0;
+    count = 0;
+    if (remaining == 0)
+      return;
+
+    uint32_t header[2];
+    if (words.read(header, 2) != 2)
+    {
+      throw std::runtime_error("Truncated packed run in " + filename);
+    }
+    size_t n = header[1] & 0xffff;
+    uint32_t bits = header[1] >> 16;
+    if (n == 0 || n > PACKED_BLOCK || n > static_cast<unsigned long long>(remaining) || bits > 32)
+    {
+      throw std::runtime_error("Corrupt packed run in " + filename);
+    }
+    size_t packedWords = ((n - 1) * bits + 31) / 32;
+    uint32_t packed[PACKED_BLOCK + 2];
+    if (words.read(packed, packedWords) != packedWords)
+    {
+      throw std::runtime_error("Truncated packed run in " + filename);
+    }
+    packed[packedWords] = packed[packedWords + 1] = 0; // the unpack reads past the last gap
+
+    // Unpack the gaps, then add them up
+    uint32_t gaps[PACKED_BLOCK];
+    const uint32_t mask = static_cast<uint32_t>((1ULL << bits) - 1);
+    for (size_t i = 0; i + 1 < n; i++)
+    {
+      size_t bit = i * bits;
+      uint64_t window = packed[bit >> 5] | static_cast<uint64_t>(packed[(bit >> 5) + 1]) << 32;
+      gaps[i] = static_cast<uint32_t>(window >> (bit & 31)) & mask;
+    }
+    uint32_t value = header[0];
+    values[0] = static_cast<int>(value);
+    for (size_t i = 1; i < n; i++)
+    {
+      value += gaps[i - 1];
+      values[i] = static_cast<int>(value);
+    }
+    count = n;
+    remaining -= n;
+  }
+};
+
+#endif
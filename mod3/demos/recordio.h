@@ -0,0 +1,357 @@
+#ifndef RECORDIO_H
+#define RECORDIO_H
+
+// Block-buffered record I/O for binary files of fixed-size records.
+// Records are moved a whole buffer at a time with pread/pwrite instead of one
+// stream call per record; a reader can also map its range with mmap.
+// POSIX only.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const size_t DEFAULT_IO_BUFFER_BYTES = 1 << 20; // 1 MiB per reader or writer
+const size_t IO_ALIGNMENT = 4096;              // page size; also suits O_DIRECT
+
+// Throws the last system error with some context
+inline void throwSystemError(const std::string &what, const std::string &filename)
+{
+  throw std::runtime_error(what + " " + filename + ": " + std::strerror(errno));
+}
+
+// Allocates a page-aligned buffer big enough for bufferBytes, rounded down to whole records
+template <typename T>
+T *allocateRecordBuffer(size_t bufferBytes, size_t &capacity)
+{
+  capacity = std::max<size_t>(bufferBytes / sizeof(T), 1);
+  size_t bytes = (capacity * sizeof(T) + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+  void *buffer = std::aligned_alloc(IO_ALIGNMENT, bytes);
+  if (buffer == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return static_cast<T *>(buffer);
+}
+
+// Number of whole records in a file
+template <typename T>
+long long countRecords(const std::string &filename)
+{
+  struct stat info;
+  if (::stat(filename.c_str(), &info) != 0)
+  {
+    throwSystemError("Error reading size of", filename);
+  }
+  return info.st_size / sizeof(T);
+}
+
+// Reads the records [offset, offset + length) of a file; length < 0 reads to the end
+template <typename T>
+class RecordReader
+{
+  static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+
+public:
+  RecordReader(const std::string &filename, long long offset = 0, long long length = -1,
+               bool useMmap = false, size_t bufferBytes = DEFAULT_IO_BUFFER_BYTES)
+      : filename(filename)
+  {
+    fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+      throwSystemError("Error opening", filename);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throwSystemError("Error reading size of", filename);
+    }
+
+    long long fileRecords = info.st_size / sizeof(T);
+    next = std::min(offset, fileRecords);
+    end = length < 0 ? fileRecords : std::min(fileRecords, offset + length);
+
+    if (useMmap && end > next)
+    {
+      // Map the whole range at once; the kernel reads ahead for us
+      off_t start = next * sizeof(T);
+      off_t pageStart = start / IO_ALIGNMENT * IO_ALIGNMENT;
+      mapLength = (end - next) * sizeof(T) + (start - pageStart);
+      map = ::mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, fd, pageStart);
+      if (map == MAP_FAILED)
+      {
+        ::close(fd);
+        throwSystemError("Error mapping", filename);
+      }
+      ::madvise(map, mapLength, MADV_SEQUENTIAL);
+      data = reinterpret_cast<const T *>(static_cast<const char *>(map) + (start - pageStart));
+      count = end - next;
+      next = end;
+    }
+    else
+    {
+      try
+      {
+        buffer = allocateRecordBuffer<T>(bufferBytes, capacity);
+        data = buffer;
+        fill();
+      }
+      catch (...)
+      {
+        // The destructor does not run for a constructor that throws
+        std::free(buffer);
+        ::close(fd);
+        throw;
+      }
+    }
+  }
+
+  RecordReader(const RecordReader &) = delete;
+  RecordReader &operator=(const RecordReader &) = delete;
+
+  ~RecordReader()
+  {
+    if (map != nullptr)
+      ::munmap(map, mapLength);
+    std::free(buffer);
+    ::close(fd);
+  }
+
+  // True when every record of the range was consumed
+  bool isEmpty() const
+  {
+    return position == count;
+  }
+
+  // The next record; only valid if !isEmpty()
+  const T &current() const
+  {
+    return data[position];
+  }
+
+  void advance()
+  {
+    if (++position == count)
+      fill();
+  }
+
+  // Reads one record
+  bool read(T &value)
+  {
+    if (isEmpty())
+      return false;
+    value = current();
+    advance();
+    return true;
+  }
+
+  // Reads up to n records and returns how many were read
+  size_t read(T *out, size_t n)
+  {
+    size_t done = 0;
+    while (done < n && !isEmpty())
+    {
+      size_t chunk = std::min(n - done, count - position);
+      std::memcpy(out + done, data + position, chunk * sizeof(T));
+      done += chunk;
+      position += chunk;
+      if (position == count)
+      {
+        // Large requests bypass the buffer
+        if (buffer != nullptr && n - done >= capacity)
+        {
+          size_t direct = readRecords(out + done, std::min<long long>(n - done, end - next));
+          done += direct;
+          next += direct;
+        }
+        fill();
+      }
+    }
+    return done;
+  }
+
+private:
+  std::string filename;
+  int fd = -1;
+  T *buffer = nullptr;       // buffered backend
+  size_t capacity = 0;       // records per buffer
+  void *map = nullptr;       // mmap backend
+  size_t mapLength = 0;
+  const T *data = nullptr;   // records of the current block
+  size_t position = 0, count = 0;
+  long long next = 0, end = 0; // file position of the next block and end of the range, in records
+
+  // Refills the buffer with the next block
+  void fill()
+  {
+    position = 0;
+    count = 0;
+    if (buffer == nullptr || next >= end)
+      return;
+    count = readRecords(buffer, std::min<long long>(capacity, end - next));
+    next += count;
+  }
+
+  // Reads n records at file position next
+  size_t readRecords(T *out, size_t n)
+  {
+    char *bytes = reinterpret_cast<char *>(out);
+    size_t total = n * sizeof(T), done = 0;
+    while (done < total)
+    {
+      ssize_t got = ::pread(fd, bytes + done, total - done, next * sizeof(T) + done);
+      if (got < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throwSystemError("Error reading", filename);
+      }
+      if (got == 0)
+        break;
+      done += got;
+    }
+    return done / sizeof(T);
+  }
+};
+
+// How a RecordWriter opens its file
+enum class WriteMode
+{
+  Truncate, // create or empty the file
+  Update    // keep the content and overwrite from the given offset
+};
+
+// Writes records sequentially, starting at record offset
+template <typename T>
+class RecordWriter
+{
+  static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+
+public:
+  RecordWriter(const std::string &filename, WriteMode mode = WriteMode::Truncate, long long offset = 0,
+               size_t bufferBytes = DEFAULT_IO_BUFFER_BYTES)
+      : filename(filename), next(offset)
+  {
+    int flags = O_WRONLY | O_CREAT | (mode == WriteMode::Truncate ? O_TRUNC : 0);
+    fd = ::open(filename.c_str(), flags, 0644);
+    if (fd < 0)
+    {
+      throwSystemError("Error opening", filename);
+    }
+    try
+    {
+      buffer = allocateRecordBuffer<T>(bufferBytes, capacity);
+    }
+    catch (...)
+    {
+      ::close(fd);
+      throw;
+    }
+  }
+
+  RecordWriter(const RecordWriter &) = delete;
+  RecordWriter &operator=(const RecordWriter &) = delete;
+
+  ~RecordWriter()
+  {
+    try
+    {
+      close();
+    }
+    catch (...)
+    {
+      // Call close() to see write errors
+    }
+    std::free(buffer);
+  }
+
+  void write(const T &value)
+  {
+    buffer[count++] = value;
+    if (count == capacity)
+      flush();
+  }
+
+  // Writes n records
+  void write(const T *values, size_t n)
+  {
+    if (count + n <= capacity)
+    {
+      std::memcpy(buffer + count, values, n * sizeof(T));
+      count += n;
+      if (count == capacity)
+        flush();
+      return;
+    }
+    flush();
+    if (n < capacity)
+    {
+      std::memcpy(buffer, values, n * sizeof(T));
+      count = n;
+    }
+    else
+    {
+      // Large blocks bypass the buffer
+      writeRecords(values, n);
+    }
+  }
+
+  void flush()
+  {
+    writeRecords(buffer, count);
+    count = 0;
+  }
+
+  // File position of the next record written, in records
+  long long position() const
+  {
+    return next + count;
+  }
+
+  void close()
+  {
+    if (fd < 0)
+      return;
+    flush();
+    ::close(fd);
+    fd = -1;
+  }
+
+private:
+  std::string filename;
+  int fd = -1;
+  T *buffer = nullptr;
+  size_t capacity = 0, count = 0;
+  long long next; // file position of the next write, in records
+
+  void writeRecords(const T *values, size_t n)
+  {
+    const char *bytes = reinterpret_cast<const char *>(values);
+    size_t total = n * sizeof(T), done = 0;
+    while (done < total)
+    {
+      ssize_t put = ::pwrite(fd, bytes + done, total - done, next * sizeof(T) + done);
+      if (put < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        throwSystemError("Error writing", filename);
+      }
+      done += put;
+    }
+    next += n;
+  }
+};
+
+#endif
@@ -0,0 +1,54 @@
+// Selection demos: median, top-k and partial sort without a full sort
+// Build: g++ -std=c++17 -O2 selection.cpp
+// Usage: selection [file of ints, e.g. largedata.dat from createLargeFile] [k]
+#include <iostream>
+#include <string>
+#include <vector>
+#include "selection.h"
+
+template <typename T>
+void print(const std::vector<T> &v)
+{
+  for (auto e : v)
+  {
+    std::cout << e << ' ';
+  }
+  std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<int> vec = {9, 4, 7, 1, 8, 2, 6, 3, 5, 0, 4, 4};
+
+  // Median
+  std::vector<int> v1 = vec;
+  nthElement(v1, v1.size() / 2);
+  std::cout << "median: " << v1[v1.size() / 2] << std::endl;
+
+  // The three largest, largest first
+  std::vector<int> v2 = vec;
+  partialSort(v2, 3, std::greater<int>());
+  print(std::vector<int>(v2.begin(), v2.begin() + 3));
+
+  // The four smallest of a stream, keeping only four elements
+  TopK<int> top(4);
+  for (int i = 0; i < 1000000; i++)
+    top.push(static_cast<int>(i * 7919LL % 1000003));
+  print(top.extractSorted());
+
+  // The same on a file of ints that does not have to fit in memory
+  if (argc > 1)
+  {
+    std::string filename = argv[1];
+    size_t k = argc > 2 ? std::stoul(argv[2]) : 10;
+    long long n = countRecords<int>(filename);
+    if (n == 0)
+      return 0;
+
+    std::cout << "top " << k << " of " << n << ": ";
+    print(topKFromFile<int>(filename, k, std::greater<int>()));
+    std::cout << "median: " << selectFromFile<int>(filename, n / 2) << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,304 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+// Selection without a full sort: the k-th element (introselect), the first k
+// in order (partial sort), the k best of a stream (top-k with a bounded heap),
+// and the same for files of records too large for memory.
+// comp orders the elements as in std::sort: the "top k" are the first k of the sorted order.
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "heap.h"
+#include "recordio.h"
+
+const size_t SELECTION_SMALL_SIZE = 16;                     // ranges this small are insertion sorted
+const size_t DEFAULT_SELECTION_MEMORY = 64 * 1024 * 1024; // bytes of candidates kept by selectFromFile
+
+// Insertion sort of a small range
+template <typename T, typename Compare>
+void insertionSortSmall(T *first, T *last, Compare comp)
+{
+  for (T *i = first + 1; i < last; i++)
+  {
+    T value = std::move(*i);
+    T *k = i;
+    for (; k > first && comp(value, *(k - 1)); k--)
+      *k = std::move(*(k - 1));
+    *k = std::move(value);
+  }
+}
+
+// Moves the median of *first, the middle and the last element to *first
+template <typename T, typename Compare>
+void medianOfThreeToFirst(T *first, T *last, Compare comp)
+{
+  T *a = first, *b = first + (last - first) / 2, *c = last - 1;
+  if (comp(*b, *a))
+    std::swap(a, b);
+  if (comp(*c, *b))
+    b = comp(*c, *a) ? a : c;
+  std::iter_swap(first, b);
+}
+
+template <typename T, typename Compare>
+void nthElement(T *first, T *nth, T *last, Compare comp);
+
+// Moves the median of the medians of groups of five to *first; this pivot
+// always leaves at least 3/10 of the range on each side
+template <typename T, typename Compare>
+void medianOfMediansToFirst(T *first, T *last, Compare comp)
+{
+  size_t n = last - first, groups = n / 5;
+  for (size_t g = 0; g < groups; g++)
+  {
+    T *group = first + 5 * g;
+    insertionSortSmall(group, group + 5, comp);
+    std::iter_swap(first + g, group + 2);
+  }
+  nthElement(first, first + groups / 2, first + groups, comp);
+  std::iter_swap(first, first + groups / 2);
+}
+
+// Dutch national flag partition around the pivot *first:
+// [first, lt) < pivot, [lt, gt) = pivot, [gt, last) > pivot; returns {lt, gt}
+template <typename T, typename Compare>
+std::pair<T *, T *> partitionAroundFirst(T *first, T *last, Compare comp)
+{
+  T pivot = *first;
+  T *lt = first, *i = first + 1, *gt = last;
+  while (i < gt)
+  {
+    if (comp(*i, pivot))
+      std::iter_swap(lt++, i++);
+    else if (comp(pivot, *i))
+      std::iter_swap(i, --gt);
+    else
+      i++;
+  }
+  return {lt, gt};
+}
+
+// Introselect: rearranges [first, last) so that *nth is the element a full sort
+// would put there, nothing before it is greater and nothing after it is less.
+// Quickselect on a median-of-three pivot, which switches to the median of
+// medians after log2(n) steps that dropped less than 1/4 of the range: O(n) worst case.
+template <typename T, typename Compare>
+void nthElement(T *first, T *nth, T *last, Compare comp)
+{
+  if (nth >= last)
+    return;
+  int badSteps = 0;
+  for (size_t n = last - first; n > 1; n >>= 1)
+    badSteps++;
+
+  while (static_cast<size_t>(last - first) > SELECTION_SMALL_SIZE)
+  {
+    size_t n = last - first;
+    if (badSteps > 0)
+      medianOfThreeToFirst(first, last, comp);
+    else
+      medianOfMediansToFirst(first, last, comp);
+
+    std::pair<T *, T *> pivots = partitionAroundFirst(first, last, comp);
+    if (nth < pivots.first)
+      last = pivots.first;
+    else if (nth >= pivots.second)
+      first = pivots.second;
+    else
+      return; // nth is among the keys equal to the pivot
+
+    if (static_cast<size_t>(last - first) > n / 4 * 3)
+      badSteps--;
+  }
+  insertionSortSmall(first, last, comp);
+}
+
+template <typename T, typename Compare = std::less<T>>
+void nthElement(std::vector<T> &vec, size_t nth, Compare comp = Compare())
+{
+  nthElement(vec.data(), vec.data() + nth, vec.data() + vec.size(), comp);
+}
+
+// Puts the first k elements of the sorted order, sorted, at the front; the rest
+// is left in no particular order. O(n + k log k).
+template <typename T, typename Compare = std::less<T>>
+void partialSort(std::vector<T> &vec, size_t k, Compare comp = Compare())
+{
+  k = std::min(k, vec.size());
+  if (k == 0)
+    return;
+  nthElement(vec.data(), vec.data() + k - 1, vec.data() + vec.size(), comp);
+  std::sort(vec.begin(), vec.begin() + k, comp);
+}
+
+// The k first elements of a stream in O(k) memory. The heap's maximum is the
+// worst element kept, so most elements of a long stream are turned away by one comparison.
+template <typename T, typename Compare = std::less<T>>
+class TopK
+{
+public:
+  TopK(size_t k, Compare comp = Compare()) : k(k), comp(comp), heap(comp) {}
+
+  void push(const T &value)
+  {
+    if (heap.getSize() < k)
+      heap.insert(value);
+    else if (k > 0 && comp(value, heap.getMax()))
+      heap.replaceMax(value);
+  }
+
+  size_t getSize() const
+  {
+    return heap.getSize();
+  }
+
+  // The elements kept, sorted; the TopK is left empty
+  std::vector<T> extractSorted()
+  {
+    return heap.extractSorted();
+  }
+
+private:
+  size_t k;
+  Compare comp;
+  Heap<T, Compare> heap;
+};
+
+// The k first records of a file in sorted order, in one pass and O(k) memory
+template <typename R, typename Compare = std::less<R>>
+std::vector<R> topKFromFile(const std::string &filename, size_t k, Compare comp = Compare(), bool useMmap = false)
+{
+  TopK<R, Compare> top(k, comp);
+  for (RecordReader<R> input(filename, 0, -1, useMmap); !input.isEmpty(); input.advance())
+    top.push(input.current());
+  return top.extractSorted();
+}
+
+// The record of the given rank (0 is the first of the sorted order) of a file
+// that may not fit in memory. The answer is known to lie strictly between two
+// bounds, which start open. Each pass counts the records at or below the lower
+// bound and keeps those between the bounds, up to the memory budget, together
+// with a random sample of them. If they all fit, the answer is selected in
+// memory. If not, two pivots are drawn from the sample around the rank. The
+// next pass counts the records equal to and outside the pivots. The answer is
+// then one of the pivots, or the pivots become the new bounds. A few passes
+// suffice even for very large files.
+template <typename R, typename Compare = std::less<R>>
+R selectFromFile(const std::string &filename, long long rank, Compare comp = Compare(),
+                 size_t memoryBudget = DEFAULT_SELECTION_MEMORY, bool useMmap = false)
+{
+  long long n = countRecords<R>(filename);
+  if (rank < 0 || rank >= n)
+  {
+    throw std::runtime_error("Rank " + std::to_string(rank) + " is out of range for " + filename);
+  }
+
+  const size_t capacity = std::max<size_t>(memoryBudget / sizeof(R), 1024);
+  const size_t sampleSize = std::min<size_t>(capacity / 4, 1 << 16);
+  bool hasLow = false, hasHigh = false, hasPivots = false;
+  R low{}, high{}, lo{}, hi{};
+  long long below = 0;  // records at or below low
+  double width = 0.5;   // share of the budget the pivots aim to keep between them
+  unsigned long long seed = 88172645463325252ULL;
+
+  while (true)
+  {
+    std::vector<R> candidates, sample;
+    long long lessLo = 0, equalLo = 0, between = 0, equalHi = 0;
+    for (RecordReader<R> input(filename, 0, -1, useMmap); !input.isEmpty(); input.advance())
+    {
+      const R &value = input.current();
+      if (hasHigh && !comp(value, high))
+        continue;
+      if (hasLow && !comp(low, value))
+        continue;
+      if (hasPivots)
+      {
+        if (comp(value, lo))
+        {
+          lessLo++;
+          continue;
+        }
+        if (!comp(lo, value))
+        {
+          equalLo++;
+          continue;
+        }
+        if (comp(hi, value))
+          continue;
+        if (!comp(value, hi))
+        {
+          equalHi++;
+          continue;
+        }
+      }
+      if (candidates.size() < capacity)
+        candidates.push_back(value);
+
+      // Reservoir sample of the records between the bounds
+      if (sample.size() < sampleSize)
+        sample.push_back(value);
+      else
+      {
+        seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17; // xorshift64
+        unsigned long long slot = seed % (between + 1);
+        if (slot < sampleSize)
+          sample[slot] = value;
+      }
+      between++;
+    }
+
+    long long target = rank - below;
+    if (hasPivots)
+    {
+      hasPivots = false;
+      if (target < lessLo)
+      {
+        // Below the pivots: the sample missed, so look wider next time
+        hasHigh = true;
+        high = lo;
+        width = std::min(1.0, width * 2);
+        continue;
+      }
+      if (target < lessLo + equalLo)
+        return lo;
+      if (target >= lessLo + equalLo + between)
+      {
+        if (target < lessLo + equalLo + between + equalHi)
+          return hi;
+        // Above the pivots
+        hasLow = true;
+        low = hi;
+        below += lessLo + equalLo + between + equalHi;
+        width = std::min(1.0, width * 2);
+        continue;
+      }
+      hasLow = hasHigh = true;
+      low = lo;
+      high = hi;
+      below += lessLo + equalLo;
+      target -= lessLo + equalLo;
+    }
+
+    if (static_cast<size_t>(between) <= capacity)
+    {
+      nthElement(candidates, target, comp);
+      return candidates[target];
+    }
+
+    // Pivots around the position of the target within the sample
+    std::sort(sample.begin(), sample.end(), comp);
+    double position = double(target) / between * sample.size();
+    double spread = width * capacity / between * sample.size() / 2;
+    long long last = static_cast<long long>(sample.size()) - 1;
+    lo = sample[std::max(0LL, std::min(last, static_cast<long long>(position - spread)))];
+    hi = sample[std::max(0LL, std::min(last, static_cast<long long>(position + spread)))];
+    hasPivots = true;
+  }
+}
+
+#endif
@@ -1,7 +1,30 @@
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include <iostream>
+#include "heap.h"
+#include "merge.h"
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+// Build: g++ -std=c++17 -O2 -mavx2 -pthread sort.cpp
 
 template <typename T>
 void print(const std::vector<T> v)
@@ -67,6 +90,9 @@ void bubbleSort(std::vector<int> &array)
   }
 }
 
+template <typename T>
+void merge(std::vector<T> &vec1, std::vector<T> &vec2, std::vector<T> &temp);
+
 // Merge sort function
 template <typename T>
 void mergeSort(std::vector<T> &vec)
@@ -106,28 +132,29 @@ void merge(std::vector<T> &vec1, std::vector<T> &vec2, std::vector<T> &temp)
 }
 
 // Quick sort function
-int partition(std::vector<int> &vec, int first, int last)
+template <typename T, typename Compare = std::less<T>>
+int partition(std::vector<T> &vec, int first, int last, Compare comp = Compare())
 {
-  int pivot = vec[first];
+  T pivot = vec[first];
   int low = first + 1;
   int high = last;
 
   while (high > low)
   {
-    while (low <= high && vec[low] <= pivot)
+    while (low <= high && !comp(pivot, vec[low]))
       low++;
 
-    while (low <= high && vec[high] > pivot)
+    while (low <= high && comp(pivot, vec[high]))
       high--;
 
     if (high > low)
       std::swap(vec[low], vec[high]);
   }
 
-  while (high > first && vec[high] >= pivot)
+  while (high > first && !comp(vec[high], pivot))
     high--;
 
-  if (pivot > vec[high])
+  if (comp(vec[high], pivot))
   {
     vec[first] = vec[high];
     vec[high] = pivot;
@@ -139,144 +166,742 @@ int partition(std::vector<int> &vec, int first, int last)
   }
 }
 
-void quickSort(std::vector<int> &vec, int first, int last)
+template <typename T, typename Compare = std::less<T>>
+void quickSort(std::vector<T> &vec, int first, int last, Compare comp = Compare())
 {
   if (last > first)
   {
-    int pivotIndex = partition(vec, first, last);
-    quickSort(vec, first, pivotIndex - 1);
-    quickSort(vec, pivotIndex + 1, last);
+    int pivotIndex = partition(vec, first, last, comp);
+    quickSort(vec, first, pivotIndex - 1, comp);
+    quickSort(vec, pivotIndex + 1, last, comp);
   }
 }
 
-void quickSort(std::vector<int> &vec)
+template <typename T, typename Compare = std::less<T>>
+void quickSort(std::vector<T> &vec, Compare comp = Compare())
 {
-  quickSort(vec, 0, vec.size() - 1);
+  quickSort(vec, 0, static_cast<int>(vec.size()) - 1, comp);
 }
 
-// The Heap class
-template <typename T>
-class Heap
+// Work-stealing task pool
+// Every worker owns a deque: it pushes and pops its own tasks at the back and
+// steals from the front of the others when it runs dry. Threads that wait
+// for a task group keep running tasks, so recursive fork-join cannot deadlock.
+class TaskPool
 {
 public:
-  // Create a max heap from a vector
-  Heap(const std::vector<T> vec)
+  // Counts the unfinished tasks spawned into it and keeps the first exception
+  // one threw. A group left by an exception still waits for its tasks, which
+  // refer to it.
+  struct TaskGroup
   {
-    for (size_t i = 0; i < vec.size(); i++)
+    std::atomic<size_t> pending{0};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    TaskPool *pool = nullptr;
+
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    ~TaskGroup()
     {
-      insert(vec[i]);
+      if (pool != nullptr)
+        pool->drain(*this);
     }
-  }
-  // Insert an element into the heap
-  void insert(const T &value)
+  };
+
+  explicit TaskPool(unsigned threads = std::thread::hardware_concurrency())
+      : queues(std::max(threads, 1u) + 1)
   {
-    // Add the new element to the end of the vector
-    data.push_back(value);
-    // Move the new element up to maintain the heap property
-    siftUp(data.size() - 1);
+    for (auto &queue : queues)
+      queue = std::make_unique<Queue>();
+    // Queue 0 collects tasks spawned by threads outside the pool
+    for (unsigned i = 1; i < queues.size(); i++)
+      workers.emplace_back([this, i] { work(i); });
   }
 
-  // Extract the maximum element from the heap
-  T extractMax()
+  ~TaskPool()
   {
-    if (isEmpty())
     {
-      throw std::runtime_error("Heap is empty");
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      stop = true;
     }
-    // Swap the first element with the last element
-    std::swap(data[0], data.back());
-    // Store the maximum element to return later
-    T maxElement = data.back();
-    // Remove the last element
-    data.pop_back();
-    // Move the new first element down to maintain the heap property
-    siftDown(0);
-    return maxElement;
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+      worker.join();
   }
 
-  // Check if the heap is empty
-  bool isEmpty() const
+  size_t size() const
   {
-    return data.empty();
+    return workers.size();
   }
 
-  // Get size
-  size_t getSize() const
+  // Runs task asynchronously as part of group
+  template <typename Function>
+  void spawn(TaskGroup &group, Function task)
   {
-    return data.size();
+    group.pool = this;
+    group.pending++;
+    Queue &queue = *queues[workerIndex()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.emplace_back([&group, task] {
+        try
+        {
+          task();
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(group.errorMutex);
+          if (!group.error)
+            group.error = std::current_exception();
+        }
+        group.pending--;
+      });
+    }
+    {
+      // Under the mutex, so a worker cannot miss the wake-up between its check and its wait
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      queued++;
+    }
+    wakeUp.notify_one();
   }
 
-  // Print heap
-  void print() const
+  // Waits for every task of group, running queued tasks meanwhile, and
+  // rethrows the first exception of a task
+  void wait(TaskGroup &group)
   {
-    for (auto e : data)
+    drain(group);
+    std::lock_guard<std::mutex> lock(group.errorMutex);
+    if (group.error)
     {
-      std::cout << e << " ";
+      std::exception_ptr error = group.error;
+      group.error = nullptr;
+      std::rethrow_exception(error);
     }
-    std::cout << std::endl;
   }
 
 private:
-  std::vector<T> data;
+  struct Queue
+  {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<size_t> queued{0};
+  std::mutex sleepMutex;
+  std::condition_variable wakeUp;
+  bool stop = false;
+
+  void drain(TaskGroup &group)
+  {
+    while (group.pending > 0)
+    {
+      if (!runOne(workerIndex()))
+        std::this_thread::yield();
+    }
+  }
+
+  // Index of the calling thread's queue; 0 outside the pool
+  static size_t &workerIndex()
+  {
+    static thread_local size_t index = 0;
+    return index;
+  }
+
+  void work(size_t self)
+  {
+    workerIndex() = self;
+    while (true)
+    {
+      if (runOne(self))
+        continue;
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wakeUp.wait(lock, [this] { return stop || queued > 0; });
+      if (stop)
+        return;
+    }
+  }
 
-  // Move an element up the heap to maintain the heap property
-  void siftUp(size_t index)
+  // Runs one task, taken from our own queue or stolen from another one
+  bool runOne(size_t self)
   {
-    while (index > 0)
+    std::function<void()> task;
+    for (size_t i = 0; i < queues.size() && !task; i++)
     {
-      size_t parentIndex = (index - 1) / 2;
-      if (data[index] <= data[parentIndex])
+      Queue &queue = *queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty())
+        continue;
+      if (i == 0)
       {
-        // The heap property is satisfied
-        break;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+      }
+      else
+      {
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
       }
-      // Swap the element with its parent
-      std::swap(data[index], data[parentIndex]);
-      index = parentIndex;
     }
+    if (!task)
+      return false;
+    queued--;
+    task();
+    return true;
   }
+};
 
-  // Move an element down the heap to maintain the heap property
-  void siftDown(size_t index)
+// Insertion sort on a range, used for small partitions
+template <typename T, typename Compare>
+void insertionSort(T *first, T *last, Compare comp)
+{
+  for (T *i = first + 1; i < last; i++)
   {
-    size_t leftChildIndex, rightChildIndex, largerChildIndex;
-    while (index < data.size())
+    T currentElement = std::move(*i);
+    T *k = i;
+    for (; k > first && comp(currentElement, *(k - 1)); k--)
     {
-      leftChildIndex = 2 * index + 1;
-      rightChildIndex = 2 * index + 2;
-      largerChildIndex = index;
+      *k = std::move(*(k - 1));
+    }
+    *k = std::move(currentElement);
+  }
+}
 
-      // Find the larger of the two children
-      if (leftChildIndex < data.size() && data[leftChildIndex] > data[largerChildIndex])
-      {
-        largerChildIndex = leftChildIndex;
-      }
-      if (rightChildIndex < data.size() && data[rightChildIndex] > data[largerChildIndex])
+const size_t SMALL_SORT_SIZE = 64;
+
+#ifdef __AVX2__
+// Compare-exchange of 8 lanes at once
+inline void minMax(__m256i &a, __m256i &b)
+{
+  __m256i low = _mm256_min_epi32(a, b);
+  b = _mm256_max_epi32(a, b);
+  a = low;
+}
+
+// Sorts up to 64 ints in registers: an optimal 19-comparator network sorts
+// the 8 columns of an 8x8 block, a transpose turns them into 8 sorted rows,
+// and rounds of merges join the rows. The input fills the block column by
+// column, so only the first n / 8 rounded up rows hold input and only those
+// n elements are merged.
+inline void simdSort64(int *a, size_t n)
+{
+  alignas(32) int block[64], merged[64];
+  std::fill(block, block + 64, std::numeric_limits<int>::max());
+  for (size_t i = 0; i < n; i++)
+    block[8 * (i % 8) + i / 8] = a[i];
+
+  __m256i r[8];
+  for (int i = 0; i < 8; i++)
+    r[i] = _mm256_load_si256(reinterpret_cast<const __m256i *>(block + 8 * i));
+
+  minMax(r[0], r[2]), minMax(r[1], r[3]), minMax(r[4], r[6]), minMax(r[5], r[7]);
+  minMax(r[0], r[4]), minMax(r[1], r[5]), minMax(r[2], r[6]), minMax(r[3], r[7]);
+  minMax(r[0], r[1]), minMax(r[2], r[3]), minMax(r[4], r[5]), minMax(r[6], r[7]);
+  minMax(r[2], r[4]), minMax(r[3], r[5]);
+  minMax(r[1], r[4]), minMax(r[3], r[6]);
+  minMax(r[1], r[2]), minMax(r[3], r[4]), minMax(r[5], r[6]);
+
+  // 8x8 transpose
+  __m256i t[8], u[8];
+  for (int i = 0; i < 8; i += 2)
+  {
+    t[i] = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+    t[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+  }
+  for (int i = 0; i < 8; i += 4)
+  {
+    u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+    u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+    u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+    u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    r[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+    r[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+  }
+  for (int i = 0; i < 8; i++)
+    _mm256_store_si256(reinterpret_cast<__m256i *>(block + 8 * i), r[i]);
+
+  // Row k holds the sorted column k; its padding sorts to the end of the last row in use
+  int *from = block, *to = merged;
+  for (size_t width = 8; width < n; width *= 2)
+  {
+    for (size_t i = 0; i < n; i += 2 * width)
+    {
+      size_t middle = std::min(i + width, n), last = std::min(i + 2 * width, n);
+      std::merge(from + i, from + middle, from + middle, from + last, to + i);
+    }
+    std::swap(from, to);
+  }
+  std::copy(from, from + n, a);
+}
+#endif
+
+// Sorts a partition of at most SMALL_SORT_SIZE elements
+template <typename T, typename Compare>
+void smallSort(T *first, T *last, Compare comp)
+{
+#ifdef __AVX2__
+  constexpr bool ascendingInts = std::is_same<T, int>::value &&
+                                 (std::is_same<Compare, std::less<int>>::value || std::is_same<Compare, std::less<>>::value);
+  if constexpr (ascendingInts)
+  {
+    if (last - first > 8)
+    {
+      simdSort64(first, last - first);
+      return;
+    }
+  }
+#endif
+  insertionSort(first, last, comp);
+}
+
+// Introsort: quicksort on a median-of-three or ninther pivot that falls back to
+// heap sort after log2(n) unbalanced splits, and leaves small partitions to smallSort
+const size_t INTROSORT_SMALL_SIZE = 32; // smaller partitions go to smallSort
+const size_t NINTHER_SIZE = 128;        // larger partitions take the median of nine samples
+
+// Orders *a, *b and *c
+template <typename T, typename Compare>
+inline void sort3(T *a, T *b, T *c, Compare comp)
+{
+  if (comp(*b, *a))
+    std::iter_swap(a, b);
+  if (comp(*c, *b))
+    std::iter_swap(b, c);
+  if (comp(*b, *a))
+    std::iter_swap(a, b);
+}
+
+// Moves the pivot, a median of three or of three medians of three (Tukey's ninther), to *first
+template <typename T, typename Compare>
+void choosePivot(T *first, T *last, Compare comp)
+{
+  size_t n = last - first;
+  T *mid = first + n / 2;
+  if (n > NINTHER_SIZE)
+  {
+    // Samples spread over the whole range, so sorted or organ-pipe input still gives a central pivot
+    size_t step = n / 8;
+    sort3(first, first + step, first + 2 * step, comp);
+    sort3(mid - step, mid, mid + step, comp);
+    sort3(last - 1 - 2 * step, last - 1 - step, last - 1, comp);
+    sort3(first + step, mid, last - 1 - step, comp);
+  }
+  else
+  {
+    sort3(first, mid, last - 1, comp);
+  }
+  std::iter_swap(first, mid);
+}
+
+// Partitions [first, last) around the pivot *first. Returns the range the pivot
+// ends up in: [first, range.first) is not greater, [range.second, last) not less.
+template <typename T, typename Compare>
+std::pair<T *, T *> partitionAroundPivot(T *first, T *last, Compare comp)
+{
+  if constexpr (std::is_arithmetic<T>::value || std::is_pointer<T>::value)
+  {
+    // Branchless Lomuto: every element is swapped with the boundary, which only
+    // advances past smaller ones, so no branch depends on a comparison
+    T pivot = *first;
+    T *boundary = first + 1;
+    for (T *i = first + 1; i < last; i++)
+    {
+      T value = *i;
+      bool smaller = comp(value, pivot);
+      *i = *boundary;
+      *boundary = value;
+      boundary += smaller;
+    }
+    std::iter_swap(first, boundary - 1);
+    return {boundary - 1, boundary};
+  }
+  else
+  {
+    // Hoare: both scans stop on keys equal to the pivot, which splits runs of duplicates evenly
+    T *low = first + 1, *high = last - 1;
+    while (true)
+    {
+      while (low <= high && comp(*low, *first))
+        low++;
+      while (low <= high && comp(*first, *high))
+        high--;
+      if (low >= high)
+        break;
+      std::iter_swap(low++, high--);
+    }
+    std::iter_swap(first, high);
+    return {high, high + 1};
+  }
+}
+
+// Dutch national flag partition around the pivot *first:
+// [first, lt) < pivot, [lt, gt) = pivot, [gt, last) > pivot; returns {lt, gt}
+template <typename T, typename Compare>
+std::pair<T *, T *> partition3Way(T *first, T *last, Compare comp)
+{
+  T pivot = *first;
+  T *lt = first, *i = first + 1, *gt = last;
+  while (i < gt)
+  {
+    if (comp(*i, pivot))
+      std::iter_swap(lt++, i++);
+    else if (comp(pivot, *i))
+      std::iter_swap(i, --gt);
+    else
+      i++;
+  }
+  return {lt, gt};
+}
+
+// Swaps a few elements of a range that a bad split left behind, so that the
+// next pivot is not picked from the same pattern again
+template <typename T>
+void breakPatterns(T *first, T *last)
+{
+  size_t n = last - first;
+  if (n < INTROSORT_SMALL_SIZE)
+    return;
+  std::iter_swap(first, first + n / 4);
+  std::iter_swap(last - 1, last - n / 4);
+  if (n > NINTHER_SIZE)
+  {
+    std::iter_swap(first + 1, first + n / 4 + 1);
+    std::iter_swap(last - 2, last - n / 4 - 1);
+  }
+}
+
+// Sorts [first, last), a part of [begin, end). badSplits is how many more
+// unbalanced partitions (smaller side under 1/8) are allowed before heap sort takes over.
+template <typename T, typename Compare>
+void introSortLoop(T *begin, T *first, T *last, int badSplits, Compare comp)
+{
+  while (static_cast<size_t>(last - first) > INTROSORT_SMALL_SIZE)
+  {
+    size_t n = last - first;
+    choosePivot(first, last, comp);
+    // The element before the range is not greater than any in it; if the pivot
+    // is not greater either, the keys repeat and the equal ones are set apart
+    std::pair<T *, T *> pivots = first != begin && !comp(*(first - 1), *first)
+                                     ? partition3Way(first, last, comp)
+                                     : partitionAroundPivot(first, last, comp);
+    size_t leftSize = pivots.first - first, rightSize = last - pivots.second;
+
+    if (std::min(leftSize, rightSize) < n / 8)
+    {
+      if (--badSplits == 0)
       {
-        largerChildIndex = rightChildIndex;
+        // Bad pivots too many times
+        std::make_heap(first, last, comp);
+        std::sort_heap(first, last, comp);
+        return;
       }
+      breakPatterns(first, pivots.first);
+      breakPatterns(pivots.second, last);
+    }
+
+    // Recurse on the smaller side and loop on the larger one, so the stack stays O(log n)
+    if (leftSize < rightSize)
+    {
+      introSortLoop(begin, first, pivots.first, badSplits, comp);
+      first = pivots.second;
+    }
+    else
+    {
+      introSortLoop(begin, pivots.second, last, badSplits, comp);
+      last = pivots.first;
+    }
+  }
+  smallSort(first, last, comp);
+}
+
+template <typename T, typename Compare = std::less<T>>
+void introSort(T *first, T *last, Compare comp = Compare())
+{
+  int badSplits = 1;
+  for (size_t n = last - first; n > 1; n >>= 1)
+    badSplits++;
+  introSortLoop(first, first, last, badSplits, comp);
+}
+
+template <typename T, typename Compare = std::less<T>>
+void introSort(std::vector<T> &vec, Compare comp = Compare())
+{
+  introSort(vec.data(), vec.data() + vec.size(), comp);
+}
+
+// Sequential merge sort of [a, a + n) using tmp[0, n) as scratch space; the
+// sorted elements end up in tmp if intoTmp, else in a. The halves are sorted
+// into the other buffer and merged back, so the buffers swap roles from one
+// level to the next and only the small sorts that must land in tmp copy.
+template <typename T, typename Compare>
+void mergeSortRange(T *a, T *tmp, size_t n, Compare comp, bool intoTmp = false)
+{
+  if (n <= SMALL_SORT_SIZE)
+  {
+    if (intoTmp)
+    {
+      std::move(a, a + n, tmp);
+      smallSort(tmp, tmp + n, comp);
+    }
+    else
+    {
+      smallSort(a, a + n, comp);
+    }
+    return;
+  }
+  size_t half = n / 2;
+  mergeSortRange(a, tmp, half, comp, !intoTmp);
+  mergeSortRange(a + half, tmp + half, n - half, comp, !intoTmp);
+  T *from = intoTmp ? a : tmp, *to = intoTmp ? tmp : a;
+  std::merge(std::make_move_iterator(from), std::make_move_iterator(from + half),
+             std::make_move_iterator(from + half), std::make_move_iterator(from + n), to, comp);
+}
+
+const size_t PARALLEL_GRAIN = 1 << 14; // smaller ranges are sorted by one thread
+
+// Parallel stable merge of a[0, na) and b[0, nb) into out[0, na + nb). The
+// output is cut into equal pieces; co-ranking finds where each piece starts
+// in a and b, so the pieces merge independently (merge path).
+template <typename It1, typename It2, typename Out, typename Compare = std::less<>>
+void parallelMerge(It1 a, size_t na, It2 b, size_t nb, Out out, TaskPool &pool, Compare comp = Compare())
+{
+  const size_t n = na + nb;
+  const size_t pieces = std::min<size_t>(4 * std::max<size_t>(pool.size(), 1), (n + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+  if (pieces <= 1)
+  {
+    std::merge(a, a + na, b, b + nb, out, comp);
+    return;
+  }
+  TaskPool::TaskGroup group;
+  for (size_t p = 0; p < pieces; p++)
+  {
+    pool.spawn(group, [=] {
+      size_t first = n * p / pieces, last = n * (p + 1) / pieces;
+      size_t i = coRank(first, a, na, b, nb, comp), j = coRank(last, a, na, b, nb, comp);
+      std::merge(a + i, a + j, b + (first - i), b + (last - j), out + first, comp);
+    });
+  }
+  pool.wait(group);
+}
 
-      if (largerChildIndex == index)
+template <typename T, typename Compare = std::less<T>>
+void parallelMerge(const std::vector<T> &a, const std::vector<T> &b, std::vector<T> &out, TaskPool &pool, Compare comp = Compare())
+{
+  out.resize(a.size() + b.size());
+  parallelMerge(a.begin(), a.size(), b.begin(), b.size(), out.begin(), pool, comp);
+}
+
+// Fork-join merge sort: the left half is spawned, the right half sorted by
+// this thread; as in mergeSortRange the result lands in tmp if intoTmp
+template <typename T, typename Compare>
+void parallelMergeSortRange(T *a, T *tmp, size_t n, Compare comp, TaskPool &pool, bool intoTmp = false)
+{
+  if (n <= PARALLEL_GRAIN)
+  {
+    mergeSortRange(a, tmp, n, comp, intoTmp);
+    return;
+  }
+  size_t half = n / 2;
+  TaskPool::TaskGroup group;
+  pool.spawn(group, [=, &pool] { parallelMergeSortRange(a, tmp, half, comp, pool, !intoTmp); });
+  parallelMergeSortRange(a + half, tmp + half, n - half, comp, pool, !intoTmp);
+  pool.wait(group);
+  // The top merges are the longest; split them across the workers too
+  T *from = intoTmp ? a : tmp, *to = intoTmp ? tmp : a;
+  parallelMerge(std::make_move_iterator(from), half, std::make_move_iterator(from + half), n - half, to, pool, comp);
+}
+
+// Parallel merge sort; the scratch buffer is allocated once
+template <typename T, typename Compare = std::less<T>>
+void parallelMergeSort(std::vector<T> &vec, TaskPool &pool, Compare comp = Compare())
+{
+  std::vector<T> tmp(vec.size());
+  parallelMergeSortRange(vec.data(), tmp.data(), vec.size(), comp, pool);
+}
+
+// Parallel sample sort: sorted samples give bucket splitters, every chunk of
+// the input is classified and scattered to its buckets in parallel, and the
+// buckets are then sorted independently
+template <typename T, typename Compare = std::less<T>>
+void parallelSampleSort(std::vector<T> &vec, TaskPool &pool, Compare comp = Compare())
+{
+  const size_t n = vec.size();
+  const size_t threads = std::max<size_t>(pool.size(), 1);
+  if (n <= PARALLEL_GRAIN * 2)
+  {
+    std::vector<T> tmp(n);
+    mergeSortRange(vec.data(), tmp.data(), n, comp);
+    return;
+  }
+
+  // Oversampling keeps bucket sizes close to n / buckets
+  const size_t buckets = 4 * threads, oversample = 32;
+  std::vector<T> samples;
+  unsigned long long seed = 88172645463325252ULL;
+  for (size_t i = 0; i < buckets * oversample; i++)
+  {
+    seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17; // xorshift64
+    samples.push_back(vec[seed % n]);
+  }
+  std::sort(samples.begin(), samples.end(), comp);
+  std::vector<T> splitters;
+  for (size_t i = 1; i < buckets; i++)
+    splitters.push_back(samples[i * oversample]);
+
+  // Classify every chunk and count its bucket sizes
+  const size_t chunks = threads, chunkSize = (n + chunks - 1) / chunks;
+  std::vector<unsigned> bucketOf(n);
+  std::vector<std::vector<size_t>> offsets(chunks, std::vector<size_t>(buckets, 0));
+  TaskPool::TaskGroup group;
+  for (size_t c = 0; c < chunks; c++)
+  {
+    pool.spawn(group, [&, c] {
+      for (size_t i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
       {
-        // The heap property is satisfied
-        break;
+        bucketOf[i] = std::upper_bound(splitters.begin(), splitters.end(), vec[i], comp) - splitters.begin();
+        offsets[c][bucketOf[i]]++;
       }
+    });
+  }
+  pool.wait(group);
 
-      // Swap the element with the larger child
-      std::swap(data[index], data[largerChildIndex]);
-      index = largerChildIndex;
+  // Exclusive prefix sums, bucket-major, give each chunk its slice of each bucket
+  std::vector<size_t> bucketStart(buckets + 1, 0);
+  size_t sum = 0;
+  for (size_t b = 0; b < buckets; b++)
+  {
+    bucketStart[b] = sum;
+    for (size_t c = 0; c < chunks; c++)
+    {
+      size_t count = offsets[c][b];
+      offsets[c][b] = sum;
+      sum += count;
     }
   }
-};
+  bucketStart[buckets] = n;
 
+  std::vector<T> tmp(n);
+  for (size_t c = 0; c < chunks; c++)
+  {
+    pool.spawn(group, [&, c] {
+      for (size_t i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+        tmp[offsets[c][bucketOf[i]]++] = std::move(vec[i]);
+    });
+  }
+  pool.wait(group);
+
+  // Sort the buckets from tmp into vec
+  for (size_t b = 0; b < buckets; b++)
+  {
+    pool.spawn(group, [&, b] {
+      size_t first = bucketStart[b], count = bucketStart[b + 1] - first;
+      mergeSortRange(tmp.data() + first, vec.data() + first, count, comp, true);
+    });
+  }
+  pool.wait(group);
+}
+
+
+// Scratch space of bottomUpMergeSort; reusing one arena across calls makes
+// the sort allocation-free once the arena has grown to the largest input
 template <typename T>
-void heapSort(std::vector<T> &vec)
+struct MergeSortArena
+{
+  std::vector<T> buffer;
+  std::vector<size_t> runs; // run boundaries
+};
+
+const size_t MIN_RUN = 32; // shorter natural runs are extended by insertion sort
+
+// Bottom-up (iterative) merge sort in the style of TimSort: natural ascending
+// runs are detected, strictly descending runs reversed and short runs extended
+// to MIN_RUN, then adjacent runs are merged pairwise, ping-ponging between the
+// vector and the arena buffer. Stable; presorted input costs O(n).
+template <typename T, typename Compare = std::less<T>>
+void bottomUpMergeSort(std::vector<T> &vec, MergeSortArena<T> &arena, Compare comp = Compare())
 {
-  Heap<T> heap(vec);
-  for (size_t i = 0; i < vec.size(); i++)
+  const size_t n = vec.size();
+  if (n < 2)
+    return;
+  if (arena.buffer.size() < n)
+    arena.buffer.resize(n);
+
+  // Find the runs
+  std::vector<size_t> &runs = arena.runs;
+  runs.clear();
+  T *a = vec.data();
+  for (size_t first = 0; first < n;)
   {
-    vec[i] = heap.extractMax();
+    runs.push_back(first);
+    size_t last = first + 1;
+    if (last < n && comp(a[last], a[first]))
+    {
+      while (last < n && comp(a[last], a[last - 1]))
+        last++;
+      std::reverse(a + first, a + last);
+    }
+    else
+    {
+      while (last < n && !comp(a[last], a[last - 1]))
+        last++;
+    }
+    if (last - first < MIN_RUN)
+    {
+      last = std::min(n, first + MIN_RUN);
+      insertionSort(a + first, a + last, comp);
+    }
+    first = last;
   }
+  runs.push_back(n);
+
+  // Merge adjacent runs until one is left
+  T *from = a, *to = arena.buffer.data();
+  while (runs.size() > 2)
+  {
+    size_t kept = 0;
+    size_t i = 0;
+    for (; i + 2 < runs.size(); i += 2)
+    {
+      std::merge(std::make_move_iterator(from + runs[i]), std::make_move_iterator(from + runs[i + 1]),
+                 std::make_move_iterator(from + runs[i + 1]), std::make_move_iterator(from + runs[i + 2]),
+                 to + runs[i], comp);
+      runs[kept++] = runs[i];
+    }
+    if (i + 1 < runs.size())
+    {
+      // An odd run out is carried over unmerged
+      std::move(from + runs[i], from + runs[i + 1], to + runs[i]);
+      runs[kept++] = runs[i];
+    }
+    runs[kept++] = n;
+    runs.resize(kept);
+    std::swap(from, to);
+  }
+  if (from != a)
+    std::move(from, from + n, a);
+}
+
+template <typename T, typename Compare = std::less<T>>
+void bottomUpMergeSort(std::vector<T> &vec, Compare comp = Compare())
+{
+  MergeSortArena<T> arena;
+  bottomUpMergeSort(vec, arena, comp);
+}
+
+template <typename T>
+void heapSort(std::vector<T> &vec)
+{
+  // Heapify in O(n), then sort inside the heap's own storage: each maximum
+  // goes to the back, so the vector ends up in ascending order
+  Heap<T> heap(std::move(vec));
+  vec = heap.extractSorted();
 }
 
 // bucket sort function
@@ -327,14 +952,14 @@ void bucketSort(std::vector<int> &arr, int low, int high)
   }
 
   // Sort individual buckets
-  for (int i = 0; i < 201; i++)
+  for (int i = 0; i < high - low + 1; i++)
   {
     std::sort(b[i].begin(), b[i].end());
   }
 
   // Concatenate all buckets into arr[]
   int index = 0;
-  for (int i = 0; i < 201; i++)
+  for (int i = 0; i < high - low + 1; i++)
   {
     for (int j = 0; j < b[i].size(); j++)
     {
@@ -343,6 +968,118 @@ void bucketSort(std::vector<int> &arr, int low, int high)
   }
 }
 
+// 3. adaptive bucket sort of integers or floats of any distribution.
+// The splitters come from a sorted random sample, so every bucket gets about the
+// same share of the input however skewed it is. Keys equal to a splitter get a
+// bucket of their own that needs no sorting, which absorbs heavy duplicates.
+// The buckets are slices of one flat array at prefix-sum offsets and are sorted
+// in parallel. NaNs are not supported.
+const size_t BUCKET_SORT_LOG_BUCKETS = 8; // 256 buckets between the splitters
+const size_t BUCKET_SORT_OVERSAMPLE = 16; // samples per splitter
+
+// Lays out sorted[next, ...) as an implicit search tree: node i has children 2i and 2i + 1
+template <typename K>
+void buildSplitterTree(const K *sorted, K *tree, size_t &next, size_t node, size_t size)
+{
+  if (node >= size)
+    return;
+  buildSplitterTree(sorted, tree, next, 2 * node, size);
+  tree[node] = sorted[next++];
+  buildSplitterTree(sorted, tree, next, 2 * node + 1, size);
+}
+
+template <typename K>
+void bucketSort(std::vector<K> &arr, TaskPool &pool)
+{
+  static_assert(std::is_arithmetic<K>::value, "bucketSort sorts numbers");
+  const size_t n = arr.size();
+  const size_t buckets = size_t(1) << BUCKET_SORT_LOG_BUCKETS;
+  if (n <= buckets * BUCKET_SORT_OVERSAMPLE)
+  {
+    introSort(arr);
+    return;
+  }
+
+  // splitters[1, buckets) are every BUCKET_SORT_OVERSAMPLE-th sample
+  std::vector<K> samples(buckets * BUCKET_SORT_OVERSAMPLE);
+  unsigned long long seed = 88172645463325252ULL;
+  for (auto &sample : samples)
+  {
+    seed ^= seed << 13, seed ^= seed >> 7, seed ^= seed << 17; // xorshift64
+    sample = arr[seed % n];
+  }
+  introSort(samples);
+  std::vector<K> splitters(buckets), tree(buckets);
+  for (size_t i = 1; i < buckets; i++)
+    splitters[i] = samples[i * BUCKET_SORT_OVERSAMPLE];
+  size_t next = 1;
+  buildSplitterTree(splitters.data(), tree.data(), next, 1, buckets);
+
+  // Class 2b holds the keys between splitters b and b + 1, class 2b - 1 the keys equal to splitter b.
+  // The tree descent has no branches: every key takes BUCKET_SORT_LOG_BUCKETS steps.
+  const size_t classes = 2 * buckets - 1;
+  auto classify = [&](K key) {
+    size_t node = 1;
+    for (size_t level = 0; level < BUCKET_SORT_LOG_BUCKETS; level++)
+      node = 2 * node + !(key < tree[node]);
+    size_t b = node - buckets; // number of splitters <= key
+    return 2 * b - (b != 0 && !(splitters[b] < key));
+  };
+
+  // Classify every chunk and count its class sizes
+  const size_t chunks = std::max<size_t>(pool.size(), 1), chunkSize = (n + chunks - 1) / chunks;
+  std::vector<uint16_t> classOf(n);
+  std::vector<size_t> offsets(chunks * classes, 0); // chunk-major counts, then write positions
+  TaskPool::TaskGroup group;
+  for (size_t c = 0; c < chunks; c++)
+  {
+    pool.spawn(group, [&, c] {
+      size_t *counts = offsets.data() + c * classes;
+      for (size_t i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+      {
+        classOf[i] = static_cast<uint16_t>(classify(arr[i]));
+        counts[classOf[i]]++;
+      }
+    });
+  }
+  pool.wait(group);
+
+  // Exclusive prefix sums, class-major, give each chunk its slice of each class
+  std::vector<size_t> classStart(classes + 1);
+  size_t sum = 0;
+  for (size_t k = 0; k < classes; k++)
+  {
+    classStart[k] = sum;
+    for (size_t c = 0; c < chunks; c++)
+    {
+      size_t count = offsets[c * classes + k];
+      offsets[c * classes + k] = sum;
+      sum += count;
+    }
+  }
+  classStart[classes] = n;
+
+  std::vector<K> flat(n);
+  for (size_t c = 0; c < chunks; c++)
+  {
+    pool.spawn(group, [&, c] {
+      size_t *positions = offsets.data() + c * classes;
+      for (size_t i = c * chunkSize; i < std::min(n, (c + 1) * chunkSize); i++)
+        flat[positions[classOf[i]]++] = arr[i];
+    });
+  }
+  pool.wait(group);
+
+  // Sort the buckets between splitters; the classes of equal keys are done
+  for (size_t k = 0; k < classes; k += 2)
+  {
+    if (classStart[k + 1] - classStart[k] > 1)
+      pool.spawn(group, [&, k] { introSort(flat.data() + classStart[k], flat.data() + classStart[k + 1]); });
+  }
+  pool.wait(group);
+  arr.swap(flat);
+}
+
 // counting sort function
 void countingSort(std::vector<int> &arr)
 {
@@ -393,7 +1130,7 @@ int getMax(const std::vector<int> &arr)
 }
 
 // Function to perform counting sort based on a specific digit represented by exp (10^i)
-void countingSort(std::vector<int> &arr, int exp)
+void countingSort(std::vector<int> &arr, long long exp)
 {
   int n = arr.size();
   std::vector<int> output(n);    // Output array
@@ -434,12 +1171,126 @@ void radixSort(std::vector<int> &arr)
   int maxVal = getMax(arr);
 
   // Do counting sort for every digit. Note that exp is 10^i where i is the current digit number
-  for (int exp = 1; maxVal / exp > 0; exp *= 10)
+  for (long long exp = 1; maxVal / exp > 0; exp *= 10)
   {
     countingSort(arr, exp);
   }
 }
 
+// LSD radix sort on bytes
+// Maps a 32- or 64-bit key to an unsigned integer with the same order:
+// signed ints get their sign bit flipped, negative floats all their bits
+// (so -0.0 sorts before 0.0, and NaNs go to the ends by their sign)
+template <typename K>
+auto radixKey(K key)
+{
+  static_assert(std::is_arithmetic<K>::value && (sizeof(K) == 4 || sizeof(K) == 8), "32- or 64-bit keys only");
+  using U = std::conditional_t<sizeof(K) == 4, uint32_t, uint64_t>;
+  constexpr U signBit = U(1) << (8 * sizeof(K) - 1);
+  U bits;
+  std::memcpy(&bits, &key, sizeof(K));
+  if constexpr (std::is_floating_point<K>::value)
+    return (bits & signBit) ? U(~bits) : U(bits | signBit);
+  else if constexpr (std::is_signed<K>::value)
+    return U(bits ^ signBit);
+  else
+    return bits;
+}
+
+// Stand-in payload type of keys-only sorts
+struct NoPayload
+{
+};
+
+// Sorts keys[0, n) together with values[0, n) using keysTmp/valuesTmp as scratch.
+// All digit histograms are counted in one pre-pass, and passes in which every
+// key has the same digit are skipped. Stable.
+template <typename K, typename V>
+void lsdRadixSort(K *keys, K *keysTmp, V *values, V *valuesTmp, size_t n)
+{
+  constexpr bool hasPayload = !std::is_same<V, NoPayload>::value;
+  constexpr int digits = sizeof(K); // one byte per pass
+
+  std::vector<size_t> counts(digits * 256, 0);
+  for (size_t i = 0; i < n; i++)
+  {
+    auto key = radixKey(keys[i]);
+    for (int d = 0; d < digits; d++)
+      counts[d * 256 + ((key >> (8 * d)) & 0xFF)]++;
+  }
+
+  K *from = keys, *to = keysTmp;
+  V *valuesFrom = values, *valuesTo = valuesTmp;
+  for (int d = 0; d < digits; d++)
+  {
+    size_t *count = counts.data() + d * 256;
+    auto key0 = radixKey(from[0]);
+    if (count[(key0 >> (8 * d)) & 0xFF] == n)
+      continue; // all keys share this digit
+
+    // Exclusive prefix sums give the first slot of every digit
+    size_t sum = 0;
+    for (int b = 0; b < 256; b++)
+    {
+      size_t c = count[b];
+      count[b] = sum;
+      sum += c;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      size_t slot = count[(radixKey(from[i]) >> (8 * d)) & 0xFF]++;
+      to[slot] = from[i];
+      if constexpr (hasPayload)
+        valuesTo[slot] = std::move(valuesFrom[i]);
+    }
+    std::swap(from, to);
+    std::swap(valuesFrom, valuesTo);
+  }
+
+  if (from != keys)
+  {
+    std::copy(from, from + n, keys);
+    if constexpr (hasPayload)
+      std::move(valuesFrom, valuesFrom + n, values);
+  }
+}
+
+// Sorts 32/64-bit integers or floats
+template <typename K>
+void lsdRadixSort(std::vector<K> &keys)
+{
+  if (keys.size() < 2)
+    return;
+  std::vector<K> keysTmp(keys.size());
+  NoPayload none;
+  lsdRadixSort<K, NoPayload>(keys.data(), keysTmp.data(), &none, &none, keys.size());
+}
+
+// Sorts keys and applies the same permutation to values
+template <typename K, typename V>
+void lsdRadixSort(std::vector<K> &keys, std::vector<V> &values)
+{
+  if (keys.size() != values.size())
+    throw std::invalid_argument("keys and values differ in size");
+  if (keys.size() < 2)
+    return;
+  std::vector<K> keysTmp(keys.size());
+  std::vector<V> valuesTmp(values.size());
+  lsdRadixSort(keys.data(), keysTmp.data(), values.data(), valuesTmp.data(), keys.size());
+}
+
+// Sorts keys and returns the original index of every sorted key
+template <typename K>
+std::vector<uint32_t> radixArgSort(std::vector<K> &keys)
+{
+  std::vector<uint32_t> indices(keys.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    indices[i] = static_cast<uint32_t>(i);
+  lsdRadixSort(keys, indices);
+  return indices;
+}
+
 // String radix sort
 // Function to get the maximum length of strings in the array
 int getMaxLength(const std::vector<std::string> &arr)
@@ -504,6 +1355,156 @@ void radixSort(std::vector<std::string> &arr)
   }
 }
 
+// MSD radix sort and multikey quicksort for strings
+// Items are std::string_views or pointers to std::strings; only the items
+// move, never the characters
+inline std::string_view keyView(std::string_view s)
+{
+  return s;
+}
+
+inline std::string_view keyView(const std::string *s)
+{
+  return *s;
+}
+
+// Character at depth as 1..256, or 0 past the end so shorter keys sort first
+template <typename Item>
+inline unsigned charAt(const Item &item, size_t depth)
+{
+  std::string_view s = keyView(item);
+  return depth < s.size() ? static_cast<unsigned char>(s[depth]) + 1 : 0;
+}
+
+const size_t MULTIKEY_THRESHOLD = 64; // smaller buckets go to multikey quicksort
+
+// Multikey quicksort (Bentley-Sedgewick) of keys that agree on their first
+// depth characters: a 3-way partition on the character at depth, then the
+// < and > parts recurse at the same depth and the = part moves one deeper
+template <typename Item>
+void multikeyQuickSort(Item *a, size_t n, size_t depth)
+{
+  while (n > 1)
+  {
+    if (n < 16)
+    {
+      insertionSort(a, a + n, [depth](const Item &x, const Item &y) {
+        std::string_view sx = keyView(x), sy = keyView(y);
+        return sx.substr(std::min(depth, sx.size())) < sy.substr(std::min(depth, sy.size()));
+      });
+      return;
+    }
+
+    // Median of three characters as the pivot
+    unsigned c0 = charAt(a[0], depth), c1 = charAt(a[n / 2], depth), c2 = charAt(a[n - 1], depth);
+    unsigned pivot = std::max(std::min(c0, c1), std::min(std::max(c0, c1), c2));
+
+    // Dutch national flag partition: [0, lt) < pivot, [lt, gt) = pivot, [gt, n) > pivot
+    size_t lt = 0, i = 0, gt = n;
+    while (i < gt)
+    {
+      unsigned c = charAt(a[i], depth);
+      if (c < pivot)
+        std::swap(a[lt++], a[i++]);
+      else if (c > pivot)
+        std::swap(a[i], a[--gt]);
+      else
+        i++;
+    }
+
+    multikeyQuickSort(a, lt, depth);
+    multikeyQuickSort(a + gt, n - gt, depth);
+    if (pivot == 0)
+      return; // the = part consists of equal keys that ended
+    a += lt;
+    n = gt - lt;
+    depth++;
+  }
+}
+
+// MSD radix sort: the characters at the current depth are read once into a
+// cache, counted and used to distribute the bucket; every non-empty bucket is
+// then sorted one character deeper. Small buckets switch to multikey
+// quicksort, so only the characters needed to tell keys apart are examined.
+template <typename Item>
+void msdRadixSort(Item *items, size_t n)
+{
+  std::vector<Item> tmp(n);
+  std::vector<uint16_t> cache(n);
+
+  // Pending buckets as (first, count, depth); no recursion on long prefixes
+  struct Bucket
+  {
+    size_t first, count, depth;
+  };
+  std::vector<Bucket> pending = {{0, n, 0}};
+  while (!pending.empty())
+  {
+    Bucket bucket = pending.back();
+    pending.pop_back();
+    Item *a = items + bucket.first;
+    if (bucket.count < MULTIKEY_THRESHOLD)
+    {
+      multikeyQuickSort(a, bucket.count, bucket.depth);
+      continue;
+    }
+
+    size_t counts[257] = {0};
+    for (size_t i = 0; i < bucket.count; i++)
+    {
+      cache[i] = charAt(a[i], bucket.depth);
+      counts[cache[i]]++;
+    }
+
+    // A shared character only deepens the bucket
+    if (counts[cache[0]] == bucket.count)
+    {
+      if (cache[0] != 0)
+        pending.push_back({bucket.first, bucket.count, bucket.depth + 1});
+      continue;
+    }
+
+    size_t starts[257], sum = 0;
+    for (int c = 0; c < 257; c++)
+    {
+      starts[c] = sum;
+      sum += counts[c];
+    }
+    for (size_t i = 0; i < bucket.count; i++)
+      tmp[starts[cache[i]]++] = a[i];
+    std::copy(tmp.begin(), tmp.begin() + bucket.count, a);
+
+    // Bucket 0 holds keys that ended, they are equal
+    for (int c = 1; c < 257; c++)
+    {
+      if (counts[c] > 1)
+        pending.push_back({bucket.first + starts[c] - counts[c], counts[c], bucket.depth + 1});
+    }
+  }
+}
+
+void msdRadixSort(std::vector<std::string_view> &keys)
+{
+  msdRadixSort(keys.data(), keys.size());
+}
+
+// Sorts pointers to the strings, then moves every string once into place
+void msdRadixSort(std::vector<std::string> &strs)
+{
+  std::vector<const std::string *> pointers(strs.size());
+  for (size_t i = 0; i < strs.size(); i++)
+    pointers[i] = &strs[i];
+  msdRadixSort(pointers.data(), pointers.size());
+
+  std::vector<std::string> sorted;
+  sorted.reserve(strs.size());
+  for (const std::string *p : pointers)
+    sorted.push_back(std::move(*const_cast<std::string *>(p)));
+  strs.swap(sorted);
+}
+
+// sortBench.cpp includes this file with SORT_NO_MAIN defined
+#ifndef SORT_NO_MAIN
 int main()
 {
   // comparison sort algorithms
@@ -533,6 +1534,15 @@ int main()
   heapSort(v6);
   print(v6);
 
+  std::vector<int> v7 = vec;
+  MergeSortArena<int> arena;
+  bottomUpMergeSort(v7, arena);
+  print(v7);
+
+  std::vector<int> v8 = vec;
+  introSort(v8);
+  print(v8);
+
   // non-comparison sort algorithms
   std::vector<float> n1 = {0.42, 0.32, 0.33, 0.52, 0.37, 0.47, 0.51};
   bucketSort(n1);
@@ -551,9 +1561,55 @@ int main()
   radixSort(n4);
   print(n4);
 
+  std::vector<int> n6 = {170, -45, 75, -90, 802, 24, -2, 66};
+  lsdRadixSort(n6);
+  print(n6);
+
+  std::vector<float> n7 = {0.5f, -1.25f, 3.0f, -0.0f, 0.0f, -7.5f};
+  std::vector<uint32_t> order = radixArgSort(n7);
+  print(n7);
+  print(order);
+
   std::vector<std::string> n5 = {"word", "category", "apple", "orange", "banana", "grape", "kiwi"};
   radixSort(n5);
   print(n5);
 
+  std::vector<std::string> n8 = {"http://b.org/x", "http://a.org/", "ftp://z", "http://a.org/index", "", "http://a.org/"};
+  msdRadixSort(n8);
+  print(n8);
+
+  // parallel sort algorithms
+  TaskPool pool;
+  std::vector<int> p1(1000000);
+  for (size_t i = 0; i < p1.size(); i++)
+    p1[i] = (i * 2654435761u) % 1000003;
+  std::vector<int> p2 = p1;
+
+  parallelMergeSort(p1, pool);
+  std::cout << "parallel merge sort: " << (std::is_sorted(p1.begin(), p1.end()) ? "sorted" : "not sorted") << std::endl;
+
+  parallelSampleSort(p2, pool, std::greater<int>());
+  std::cout << "parallel sample sort (descending): " << (std::is_sorted(p2.begin(), p2.end(), std::greater<int>()) ? "sorted" : "not sorted") << std::endl;
+
+  // Merge sorted shards lazily, then two large sorted arrays in parallel
+  std::vector<std::vector<int>> shards = {{1, 4, 9}, {2, 3, 10, 11}, {}, {0, 4, 5}};
+  KWayMerge merged(rangesOf(shards));
+  for (int x : merged)
+    std::cout << x << ' ';
+  std::cout << std::endl;
+
+  std::vector<int> p4;
+  std::reverse(p2.begin(), p2.end()); // sorted descending above
+  parallelMerge(p1, p2, p4, pool);
+  std::cout << "parallel merge: " << (std::is_sorted(p4.begin(), p4.end()) ? "sorted" : "not sorted") << std::endl;
+
+  // Heavy-tailed, like latencies: most values are small, a few are huge
+  std::vector<float> p3(p1.size());
+  for (size_t i = 0; i < p3.size(); i++)
+    p3[i] = std::exp(p1[i] % 1000 / 50.0f);
+  bucketSort(p3, pool);
+  std::cout << "adaptive bucket sort (skewed): " << (std::is_sorted(p3.begin(), p3.end()) ? "sorted" : "not sorted") << std::endl;
+
   return 0;
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,427 @@
+// Benchmark of the sort algorithms in sort.cpp
+// Build: g++ -std=c++17 -O2 -mavx2 -pthread sortBench.cpp
+// Usage: sortBench [--sizes=1e3,1e4,...] [--distributions=uniform,sorted,...]
+//                  [--algorithms=quickSort,...] [--repeat=N] [--seed=N]
+//                  [--quadratic-limit=N] [--no-counts] [--output=file.csv]
+//
+// Every algorithm runs over every distribution and size and one CSV line is
+// written per run: ns/element (best of --repeat runs), heap allocations, and
+// the cache and branch misses from perf_event when the kernel allows it.
+// Comparisons and moves are counted in a separate run on an instrumented
+// element type, for the algorithms that are templates.
+#define SORT_NO_MAIN
+#include "sort.cpp"
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <new>
+#include <random>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Heap allocations, counted by the replaced global operator new.
+// GCC takes the free() in the replaced operator delete for a mismatch.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+std::atomic<unsigned long long> allocations{0};
+
+void *operator new(size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size ? size : 1))
+    return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  std::free(p);
+}
+
+// An int that counts its comparisons and moves
+struct Counted
+{
+  int value = 0;
+  inline static std::atomic<unsigned long long> comparisons{0}, moves{0};
+
+  Counted() = default;
+  Counted(int value) : value(value) {}
+  Counted(const Counted &other) : value(other.value) { moves.fetch_add(1, std::memory_order_relaxed); }
+  Counted &operator=(const Counted &other)
+  {
+    value = other.value;
+    moves.fetch_add(1, std::memory_order_relaxed);
+    return *this;
+  }
+
+  friend bool operator<(const Counted &a, const Counted &b) { return count(a.value < b.value); }
+  friend bool operator>(const Counted &a, const Counted &b) { return count(a.value > b.value); }
+  friend bool operator<=(const Counted &a, const Counted &b) { return count(a.value <= b.value); }
+  friend bool operator>=(const Counted &a, const Counted &b) { return count(a.value >= b.value); }
+  friend bool operator==(const Counted &a, const Counted &b) { return count(a.value == b.value); }
+
+  static bool count(bool result)
+  {
+    comparisons.fetch_add(1, std::memory_order_relaxed);
+    return result;
+  }
+};
+
+// Hardware counters of the calling thread and the threads it starts
+class PerfCounters
+{
+public:
+  PerfCounters()
+  {
+#ifdef __linux__
+    cacheMisses = open(PERF_COUNT_HW_CACHE_MISSES);
+    branchMisses = open(PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+  }
+
+  ~PerfCounters()
+  {
+#ifdef __linux__
+    if (cacheMisses >= 0)
+      close(cacheMisses);
+    if (branchMisses >= 0)
+      close(branchMisses);
+#endif
+  }
+
+  bool available() const
+  {
+    return cacheMisses >= 0 && branchMisses >= 0;
+  }
+
+  void start()
+  {
+#ifdef __linux__
+    for (int fd : {cacheMisses, branchMisses})
+    {
+      if (fd >= 0)
+      {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Stops counting and reads the counters
+  void stop(long long &cache, long long &branch)
+  {
+    cache = read(cacheMisses);
+    branch = read(branchMisses);
+  }
+
+private:
+  int cacheMisses = -1, branchMisses = -1;
+
+#ifdef __linux__
+  static int open(unsigned long long config)
+  {
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1; // worker threads started while counting
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+#endif
+
+  static long long read(int fd)
+  {
+#ifdef __linux__
+    long long value;
+    if (fd >= 0)
+    {
+      ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (::read(fd, &value, sizeof(value)) == sizeof(value))
+        return value;
+    }
+#endif
+    return -1;
+  }
+};
+
+// Result of one timed run
+struct Measurement
+{
+  double seconds = 0;
+  unsigned long long allocations = 0;
+  long long cacheMisses = -1, branchMisses = -1;
+  bool sorted = true;
+};
+
+PerfCounters perf;
+
+// Times sort on data, which the caller prepared outside the measurement
+template <typename T, typename Sort, typename Compare = std::less<T>>
+Measurement measure(std::vector<T> data, Sort sort, Compare comp = Compare())
+{
+  Measurement m;
+  unsigned long long allocationsBefore = allocations;
+  perf.start();
+  auto start = std::chrono::steady_clock::now();
+  sort(data);
+  auto stop = std::chrono::steady_clock::now();
+  perf.stop(m.cacheMisses, m.branchMisses);
+  m.allocations = allocations - allocationsBefore;
+  m.seconds = std::chrono::duration<double>(stop - start).count();
+  m.sorted = std::is_sorted(data.begin(), data.end(), comp);
+  return m;
+}
+
+// A benchmarked algorithm
+struct Algorithm
+{
+  std::string name;
+  bool quadratic;              // O(n^2) on every input, skipped above --quadratic-limit
+  bool quadraticOnPresorted;   // O(n^2) on sorted or duplicate-heavy input
+  std::function<Measurement(const std::vector<int> &)> run;
+  std::function<void(const std::vector<int> &)> count; // empty if not a template
+};
+
+// Adapters from a sort of std::vector<int> / std::vector<Counted>
+template <typename Sort>
+std::function<Measurement(const std::vector<int> &)> onInts(Sort sort)
+{
+  return [sort](const std::vector<int> &input) { return measure(input, sort); };
+}
+
+template <typename Sort>
+std::function<void(const std::vector<int> &)> onCounted(Sort sort)
+{
+  return [sort](const std::vector<int> &input) {
+    std::vector<Counted> data(input.begin(), input.end());
+    Counted::comparisons = 0;
+    Counted::moves = 0;
+    sort(data);
+  };
+}
+
+// The parallel sorts share pool, whose threads start before any timing
+std::vector<Algorithm> algorithms(TaskPool &pool)
+{
+  return {
+      {"selectionSort", true, false, onInts([](std::vector<int> &v) { selectionSort(v); }), nullptr},
+      {"insertionSort", true, false, onInts([](std::vector<int> &v) { insertionSort(v); }), nullptr},
+      {"bubbleSort", true, false, onInts([](std::vector<int> &v) { bubbleSort(v); }), nullptr},
+      {"mergeSort", false, false, onInts([](std::vector<int> &v) { mergeSort(v); }),
+       onCounted([](std::vector<Counted> &v) { mergeSort(v); })},
+      {"quickSort", false, true, onInts([](std::vector<int> &v) { quickSort(v); }),
+       onCounted([](std::vector<Counted> &v) { quickSort(v); })},
+      {"introSort", false, false, onInts([](std::vector<int> &v) { introSort(v); }),
+       onCounted([](std::vector<Counted> &v) { introSort(v); })},
+      {"heapSort", false, false, onInts([](std::vector<int> &v) { heapSort(v); }),
+       onCounted([](std::vector<Counted> &v) { heapSort(v); })},
+      {"bottomUpMergeSort", false, false, onInts([](std::vector<int> &v) { bottomUpMergeSort(v); }),
+       onCounted([](std::vector<Counted> &v) { bottomUpMergeSort(v); })},
+      {"parallelMergeSort", false, false, onInts([&pool](std::vector<int> &v) { parallelMergeSort(v, pool); }),
+       onCounted([&pool](std::vector<Counted> &v) { parallelMergeSort(v, pool); })},
+      {"parallelSampleSort", false, false, onInts([&pool](std::vector<int> &v) { parallelSampleSort(v, pool); }),
+       onCounted([&pool](std::vector<Counted> &v) { parallelSampleSort(v, pool); })},
+      {"bucketSort", false, false,
+       [](const std::vector<int> &input) {
+         // Scaled into [0, 1)
+         std::vector<float> data(input.size());
+         for (size_t i = 0; i < input.size(); i++)
+           data[i] = std::min(input[i] / 2147483648.0f, 0.99999994f);
+         return measure(data, [](std::vector<float> &v) { bucketSort(v); });
+       },
+       nullptr},
+      {"bucketSort(adaptive)", false, false, onInts([&pool](std::vector<int> &v) { bucketSort(v, pool); }), nullptr},
+      {"countingSort", false, false, onInts([](std::vector<int> &v) { countingSort(v); }), nullptr},
+      {"radixSort", false, false, onInts([](std::vector<int> &v) { radixSort(v); }), nullptr},
+      {"lsdRadixSort", false, false, onInts([](std::vector<int> &v) { lsdRadixSort(v); }), nullptr},
+      {"radixSort(strings)", false, false,
+       [](const std::vector<int> &input) {
+         std::vector<std::string> data;
+         for (int x : input)
+           data.push_back(std::to_string(x));
+         return measure(data, [](std::vector<std::string> &v) { radixSort(v); });
+       },
+       nullptr},
+      {"msdRadixSort(strings)", false, false,
+       [](const std::vector<int> &input) {
+         std::vector<std::string> data;
+         for (int x : input)
+           data.push_back(std::to_string(x));
+         return measure(data, [](std::vector<std::string> &v) { msdRadixSort(v); });
+       },
+       nullptr},
+      {"std::sort", false, false, onInts([](std::vector<int> &v) { std::sort(v.begin(), v.end()); }),
+       onCounted([](std::vector<Counted> &v) { std::sort(v.begin(), v.end()); })},
+  };
+}
+
+// Input distributions of non-negative ints
+std::vector<int> generate(const std::string &distribution, size_t n, std::mt19937_64 &rng)
+{
+  std::vector<int> data(n);
+  if (distribution == "uniform")
+  {
+    std::uniform_int_distribution<int> value(0, std::numeric_limits<int>::max());
+    for (auto &x : data)
+      x = value(rng);
+  }
+  else if (distribution == "sorted" || distribution == "reverse")
+  {
+    for (size_t i = 0; i < n; i++)
+      data[i] = static_cast<int>(i);
+    if (distribution == "reverse")
+      std::reverse(data.begin(), data.end());
+  }
+  else if (distribution == "few-unique")
+  {
+    std::uniform_int_distribution<int> value(0, 9);
+    for (auto &x : data)
+      x = value(rng) * 1000;
+  }
+  else if (distribution == "organ-pipe")
+  {
+    // 0, 1, ..., n/2, ..., 1, 0
+    for (size_t i = 0; i < n; i++)
+      data[i] = static_cast<int>(std::min(i, n - 1 - i));
+  }
+  else if (distribution == "zipf")
+  {
+    // Ranks with P(rank) ~ rank^-1.1, drawn by inverting the continuous CDF
+    const double s = 1.1, maxRank = std::max<double>(n, 2);
+    std::uniform_real_distribution<double> u(0, 1);
+    const double top = std::pow(maxRank, 1 - s) - 1;
+    for (auto &x : data)
+      x = static_cast<int>(std::pow(u(rng) * top + 1, 1 / (1 - s)));
+  }
+  else
+  {
+    throw std::invalid_argument("unknown distribution " + distribution);
+  }
+  return data;
+}
+
+std::vector<std::string> split(const std::string &list)
+{
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  for (std::string item; std::getline(stream, item, ',');)
+    items.push_back(item);
+  return items;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<size_t> sizes = {1000, 10000, 100000, 1000000};
+  std::vector<std::string> distributions = {"uniform", "sorted", "reverse", "few-unique", "organ-pipe", "zipf"};
+  std::vector<std::string> selected;
+  int repeat = 3;
+  unsigned long long seed = 42;
+  size_t quadraticLimit = 100000;
+  bool counts = true;
+  std::string outputFile;
+
+  try
+  {
+    for (int i = 1; i < argc; i++)
+    {
+      std::string arg = argv[i];
+      std::string value = arg.substr(arg.find('=') + 1);
+      if (arg.rfind("--sizes=", 0) == 0)
+      {
+        sizes.clear();
+        for (const auto &size : split(value))
+          sizes.push_back(static_cast<size_t>(std::stod(size))); // accepts 1e9
+      }
+      else if (arg.rfind("--distributions=", 0) == 0)
+        distributions = split(value);
+      else if (arg.rfind("--algorithms=", 0) == 0)
+        selected = split(value);
+      else if (arg.rfind("--repeat=", 0) == 0)
+        repeat = std::max(1, std::stoi(value));
+      else if (arg.rfind("--seed=", 0) == 0)
+        seed = std::stoull(value);
+      else if (arg.rfind("--quadratic-limit=", 0) == 0)
+        quadraticLimit = static_cast<size_t>(std::stod(value));
+      else if (arg == "--no-counts")
+        counts = false;
+      else if (arg.rfind("--output=", 0) == 0)
+        outputFile = value;
+      else
+        throw std::invalid_argument("unknown option " + arg);
+    }
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+
+  std::ofstream file;
+  if (!outputFile.empty())
+    file.open(outputFile);
+  std::ostream &out = outputFile.empty() ? std::cout : file;
+  if (!perf.available())
+    std::cerr << "perf_event unavailable: cache and branch misses are left empty" << std::endl;
+
+  out << "algorithm,distribution,n,ns_per_element,comparisons,moves,allocations,cache_misses,branch_misses,sorted" << std::endl;
+  TaskPool pool;
+  for (const Algorithm &algorithm : algorithms(pool))
+  {
+    if (!selected.empty() && std::find(selected.begin(), selected.end(), algorithm.name) == selected.end())
+      continue;
+    for (const std::string &distribution : distributions)
+    {
+      for (size_t n : sizes)
+      {
+        bool presorted = distribution != "uniform" && distribution != "zipf";
+        if (n > quadraticLimit && (algorithm.quadratic || (algorithm.quadraticOnPresorted && presorted)))
+          continue;
+
+        std::mt19937_64 rng(seed);
+        std::vector<int> input = generate(distribution, n, rng);
+        if (algorithm.name == "countingSort" && n > 0 &&
+            *std::max_element(input.begin(), input.end()) - *std::min_element(input.begin(), input.end()) > (1 << 27))
+          continue; // the count array would not fit
+
+        Measurement best;
+        best.seconds = std::numeric_limits<double>::max();
+        for (int r = 0; r < repeat; r++)
+        {
+          Measurement m = algorithm.run(input);
+          if (m.seconds < best.seconds)
+            best = m;
+        }
+
+        std::string comparisons, moves;
+        if (counts && algorithm.count)
+        {
+          algorithm.count(input);
+          comparisons = std::to_string(Counted::comparisons.load());
+          moves = std::to_string(Counted::moves.load());
+        }
+        auto counter = [](long long value) { return value < 0 ? std::string() : std::to_string(value); };
+
+        out << algorithm.name << ',' << distribution << ',' << n << ','
+            << (n ? best.seconds * 1e9 / n : 0) << ',' << comparisons << ',' << moves << ','
+            << best.allocations << ',' << counter(best.cacheMisses) << ',' << counter(best.branchMisses) << ','
+            << (best.sorted ? "yes" : "no") << std::endl;
+      }
+    }
+  }
+  return 0;
+}
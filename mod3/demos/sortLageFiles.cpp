@@ -1,31 +1,165 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
 #include <algorithm> // For std::sort
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <cstdlib>   // For rand() and srand()
+#include <cstring>
 #include <ctime>     // For time()
 #include <exception>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include "heap.h"
+#include "merge.h"
+#include "packedruns.h"
+#include "recordio.h"
 
 
 const int MAX_ARRAY_SIZE = 43;
 const int BUFFER_SIZE = 1000;
 
+// k-way merge defaults
+const int DEFAULT_FAN_IN = 64;                          // runs merged at once
+const size_t DEFAULT_MEMORY_BUDGET = 64 * 1024 * 1024; // bytes of RAM for runs and buffers
+const size_t PIPELINE_BUFFERS = 3;                      // runs being read, sorted and written at once
+
+// Incremental sort: a run of the target is merged with the newer runs after it
+// once they hold at least 1/LSM_SIZE_RATIO of its records
+const long long LSM_SIZE_RATIO = 4;
+
+// Options of the external sort
+struct SortOptions
+{
+  bool kway = true;                             // k-way merge instead of the 3-file balanced merge
+  int fanIn = DEFAULT_FAN_IN;                   // maximum number of runs merged in one pass
+  size_t memoryBudget = DEFAULT_MEMORY_BUDGET; // bytes
+  int threads = std::max(1u, std::thread::hardware_concurrency()); // 1 disables the pipeline
+  bool replacementSelection = false;            // runs of about twice the memory size
+  bool useMmap = false;                         // map input files instead of reading them into buffers
+  bool events = false;                          // records are Events instead of ints
+  bool verify = false;                          // check the target against the source after sorting
+  bool verifyOnly = false;                      // check an existing target without sorting
+  bool incremental = false;                     // sort only what was appended to the source since the last run
+  bool compact = false;                         // incremental: merge all runs of the target into one
+  bool compress = false;                        // ints: write the intermediate runs as packed blocks
+};
+
+// A sorted run stored in a file
+struct Run
+{
+  long long offset; // first record, or first word of a packed run
+  long long length; // number of records
+};
+
+// Orders records by a key extracted in place. keyOf may return a reference or
+// a std::tie of several fields, so records are compared without being copied.
+template <typename KeyOf, typename Compare = std::less<>>
+struct KeyLess
+{
+  KeyOf keyOf;
+  Compare comp;
+
+  template <typename R>
+  bool operator()(const R &a, const R &b) const
+  {
+    return comp(keyOf(a), keyOf(b));
+  }
+};
+
+template <typename KeyOf, typename Compare = std::less<>>
+KeyLess<KeyOf, Compare> byKey(KeyOf keyOf, Compare comp = Compare())
+{
+  return {keyOf, comp};
+}
+
+// A 64-byte event record, sorted by (timestamp, id)
+struct Event
+{
+  long long timestamp;
+  long long id;
+  char payload[48];
+};
+
 // Function prototypes
 void xsort(const std::string &sourcefile, const std::string &targetfile);
 int initializeSegments(int segmentSize, const std::string &originalFile, const std::string &f1);
 void xmerge(int numberOfSegments, int segmentSize, const std::string &f1, const std::string &f2, const std::string &f3, const std::string &targetfile);
 void mergeOneStep(int numberOfSegments, int segmentSize, const std::string &f1, const std::string &f2, const std::string &f3);
-void copyHalfToF2(int numberOfSegments, int segmentSize, std::ifstream &f1, std::ofstream &f2);
-void mergeSegments(int numberOfSegments, int segmentSize, std::ifstream &f1, std::ifstream &f2, std::ofstream &f3);
-void mergeTwoSegments(int segmentSize, std::ifstream &f1, std::ifstream &f2, std::ofstream &f3);
+void copyHalfToF2(int numberOfSegments, int segmentSize, RecordReader<int> &f1, RecordWriter<int> &f2);
+void mergeSegments(int numberOfSegments, int segmentSize, RecordReader<int> &f1, RecordReader<int> &f2, RecordWriter<int> &f3);
+void mergeTwoSegments(int segmentSize, RecordReader<int> &f1, RecordReader<int> &f2, RecordWriter<int> &f3);
 void displayFile(const std::string &filename);
+void xsort(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options);
+template <typename R, typename Less = std::less<R>>
+void xsort(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less = Less());
+template <typename R, typename Less>
+bool sortFile(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less);
+template <typename R, typename Less>
+size_t xsortIncremental(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less);
+bool readManifest(const std::string &targetfile, long long &sorted, std::vector<Run> &runs);
+void writeManifest(const std::string &targetfile, long long sorted, const std::vector<Run> &runs);
+template <typename R, typename RunWriter, typename RunReader, typename Less>
+void xsortRuns(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less);
+template <typename R, typename RunWriter = RecordWriter<R>, typename Less>
+std::vector<Run> createRuns(const std::string &sourcefile, const std::string &runfile, size_t runSize, bool useMmap, Less less,
+                            long long first = 0, long long length = -1);
+template <typename R, typename RunWriter = RecordWriter<R>, typename Less>
+std::vector<Run> createRunsParallel(const std::string &sourcefile, const std::string &runfile, size_t runSize, int threads, bool useMmap, Less less,
+                                    long long first = 0, long long length = -1);
+template <typename R, typename RunWriter = RecordWriter<R>, typename Less>
+std::vector<Run> createRunsReplacementSelection(const std::string &sourcefile, const std::string &runfile, size_t heapSize, bool useMmap, Less less,
+                                                long long first = 0, long long length = -1);
+size_t plainRunSize(const SortOptions &options, size_t recordSize);
+template <typename R, typename RunWriter = RecordWriter<R>, typename Less>
+std::vector<Run> createRunsWith(const SortOptions &options, const std::string &sourcefile, const std::string &runfile, Less less,
+                                long long first = 0, long long length = -1);
+template <typename R, typename RunReader = RecordReader<R>, typename RunWriter = RecordWriter<R>, typename Less>
+void xmergeKWay(std::vector<Run> runs, const SortOptions &options, const std::string &f1, const std::string &f2, const std::string &targetfile, Less less);
+template <typename RunReader, typename Output, typename Less>
+void mergeRuns(const std::string &inputfile, const std::vector<Run> &runs, size_t first, size_t last, size_t bufferBytes, bool useMmap, Output &output, Less less);
+template <typename R, typename Less>
+bool verifySort(const std::string &sourcefile, const std::string &targetfile, int threads, Less less);
+SortOptions parseOptions(int argc, char *argv[], std::string &sourcefile, std::string &targetfile);
 
-int main()
+// Build: g++ -std=c++17 -O2 -pthread sortLageFiles.cpp
+// Usage: sortLageFiles [--balanced] [--fan-in=N] [--memory=MB] [--threads=N]
+//                      [--replacement-selection] [--mmap] [--events]
+//                      [--verify | --verify-only] [--incremental [--compact]] [--compress]
+//                      [source] [target]
+int main(int argc, char *argv[])
 {
   try
   {
-    xsort("largedata.dat", "sortedfile.dat");
-    displayFile("sortedfile.dat");
+    std::string sourcefile = "largedata.dat", targetfile = "sortedfile.dat";
+    SortOptions options = parseOptions(argc, argv, sourcefile, targetfile);
+    if (options.events)
+    {
+      // Sort Event records in place by (timestamp, id)
+      auto less = byKey([](const Event &e) { return std::tie(e.timestamp, e.id); });
+      if (!sortFile<Event>(sourcefile, targetfile, options, less))
+        return 1;
+      RecordReader<Event> events(targetfile);
+      for (int i = 0; i < 10 && !events.isEmpty(); i++, events.advance())
+      {
+        std::cout << "(" << events.current().timestamp << ", " << events.current().id << ") ";
+      }
+      std::cout << std::endl;
+    }
+    else
+    {
+      if (!sortFile<int>(sourcefile, targetfile, options, std::less<int>()))
+        return 1;
+      displayFile(targetfile);
+    }
   }
   catch (const std::exception &e)
   {
@@ -41,33 +175,767 @@ void xsort(const std::string &sourcefile, const std::string &targetfile)
   xmerge(numberOfSegments, MAX_ARRAY_SIZE, "f1.dat", "f2.dat", "f3.dat", targetfile);
 }
 
+// Sorts the large file of ints with the selected merge strategy
+void xsort(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options)
+{
+  if (options.kway)
+    xsort<int>(sourcefile, targetfile, options);
+  else
+    xsort(sourcefile, targetfile);
+}
+
+// Sorts, incrementally sorts or only verifies as the options say; false if verification failed
+template <typename R, typename Less>
+bool sortFile(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less)
+{
+  if (options.verifyOnly)
+    return verifySort<R>(sourcefile, targetfile, options.threads, less);
+
+  if (options.incremental)
+  {
+    size_t runs = xsortIncremental<R>(sourcefile, targetfile, options, less);
+    if (runs > 1)
+    {
+      // The target is only sorted as a whole once its runs are merged
+      if (options.verify)
+        std::cout << "verify: skipped, " << targetfile << " holds " << runs << " sorted runs (merge them with --compact)" << std::endl;
+      return true;
+    }
+  }
+  else
+  {
+    // A full sort replaces the runs of an earlier incremental sort
+    std::remove((targetfile + ".runs").c_str());
+    if constexpr (std::is_same<R, int>::value && std::is_same<Less, std::less<int>>::value)
+      xsort(sourcefile, targetfile, options);
+    else
+      xsort<R>(sourcefile, targetfile, options, less);
+  }
+  return !options.verify || verifySort<R>(sourcefile, targetfile, options.threads, less);
+}
+
+// Sorts a large file of fixed-size records R ordered by less with the k-way merge
+template <typename R, typename Less>
+void xsort(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less)
+{
+  if constexpr (std::is_same<R, int>::value)
+  {
+    if (options.compress)
+    {
+      xsortRuns<R, PackedRunWriter, PackedRunReader>(sourcefile, targetfile, options, less);
+      return;
+    }
+  }
+  else if (options.compress)
+  {
+    throw std::invalid_argument("--compress needs int records");
+  }
+  xsortRuns<R, RecordWriter<R>, RecordReader<R>>(sourcefile, targetfile, options, less);
+}
+
+// Creates the sorted runs with RunWriter and merges them with RunReader
+template <typename R, typename RunWriter, typename RunReader, typename Less>
+void xsortRuns(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less)
+{
+  std::vector<Run> runs = createRunsWith<R, RunWriter>(options, sourcefile, "f1.dat", less);
+
+  long long total = 0;
+  for (const Run &run : runs)
+    total += run.length;
+  std::cout << "runs: " << runs.size() << ", average run length: "
+            << (runs.empty() ? 0 : total / static_cast<long long>(runs.size()));
+  if (options.replacementSelection)
+  {
+    // What the runs would have been without replacement selection
+    long long runSize = static_cast<long long>(plainRunSize(options, sizeof(R)));
+    std::cout << " (without replacement selection: " << (total + runSize - 1) / runSize << " runs of " << runSize << ")";
+  }
+  std::cout << std::endl;
+  if (options.compress && total > 0)
+  {
+    std::cout << "packed runs: " << double(countRecords<char>("f1.dat")) / total << " bytes per record" << std::endl;
+  }
+  xmergeKWay<R, RunReader, RunWriter>(runs, options, "f1.dat", "f2.dat", targetfile, less);
+}
+
+// Cuts the records [first, first + length) of the source (all of it by default)
+// into sorted runs with the method the options select
+template <typename R, typename RunWriter, typename Less>
+std::vector<Run> createRunsWith(const SortOptions &options, const std::string &sourcefile, const std::string &runfile, Less less,
+                                long long first, long long length)
+{
+  if (options.replacementSelection)
+  {
+    // The heap holds as many records as the whole memory budget; the merge still uses the threads
+    size_t heapSize = std::max<size_t>(options.memoryBudget / sizeof(R), 1);
+    return createRunsReplacementSelection<R, RunWriter>(sourcefile, runfile, heapSize, options.useMmap, less, first, length);
+  }
+  size_t runSize = plainRunSize(options, sizeof(R));
+  if (options.threads > 1)
+    return createRunsParallel<R, RunWriter>(sourcefile, runfile, runSize, options.threads, options.useMmap, less, first, length);
+  return createRuns<R, RunWriter>(sourcefile, runfile, runSize, options.useMmap, less, first, length);
+}
+
+// Records per run when runs are loaded, sorted and stored: the whole memory
+// budget, so most inputs need a single merge pass, or with threads a share of
+// it, since the pipeline keeps PIPELINE_BUFFERS buffers in flight
+size_t plainRunSize(const SortOptions &options, size_t recordSize)
+{
+  size_t buffers = options.threads > 1 ? PIPELINE_BUFFERS : 1;
+  return std::max<size_t>(options.memoryBudget / buffers / recordSize, 1);
+}
+
+// Incremental sort of a source file that grows by appended records. The target
+// is a sequence of sorted runs, listed with the number of source records they
+// hold in the manifest targetfile.runs. Only the records appended since the
+// last call are sorted; that new run is then merged in one streaming pass with
+// the newest runs of the target that are at most LSM_SIZE_RATIO times larger
+// (size-tiered, as in an LSM tree). The target so holds O(log n) runs and
+// every record is merged O(log n) times, instead of resorting the whole file
+// on each append. --compact merges all runs, which leaves the target sorted.
+// Returns the number of runs in the target.
+template <typename R, typename Less>
+size_t xsortIncremental(const std::string &sourcefile, const std::string &targetfile, const SortOptions &options, Less less)
+{
+  long long sorted = 0;
+  std::vector<Run> runs;
+  if (!readManifest(targetfile, sorted, runs))
+  {
+    // First call: a full sort
+    xsort<R>(sourcefile, targetfile, options, less);
+    sorted = countRecords<R>(targetfile);
+    if (sorted > 0)
+      runs.push_back({0, sorted});
+    writeManifest(targetfile, sorted, runs);
+    return runs.size();
+  }
+
+  long long total = 0;
+  for (const Run &run : runs)
+    total += run.length;
+  long long n = countRecords<R>(sourcefile);
+  long long targetRecords = countRecords<R>(targetfile);
+  if (n < sorted || sorted != total || targetRecords < total)
+  {
+    throw std::runtime_error(sourcefile + " or " + targetfile + " changed other than by appending; sort again without --incremental");
+  }
+  if (targetRecords > total && ::truncate(targetfile.c_str(), total * sizeof(R)) != 0)
+  {
+    // Records past the runs of the manifest were left by an interrupted call
+    throwSystemError("Error truncating", targetfile);
+  }
+
+  // Sort the appended records into the single run f3.dat
+  long long appended = n - sorted;
+  std::vector<Run> newRuns = createRunsWith<R>(options, sourcefile, "f1.dat", less, sorted, appended);
+  xmergeKWay<R>(newRuns, options, "f1.dat", "f2.dat", "f3.dat", less);
+
+  // Pick the newest runs to merge with it; too many runs for one merge are all merged
+  bool mergeAll = options.compact || runs.size() + 1 > static_cast<size_t>(options.fanIn);
+  size_t first = runs.size();
+  long long length = appended;
+  while (first > 0 && (mergeAll || runs[first - 1].length <= LSM_SIZE_RATIO * length))
+    length += runs[--first].length;
+
+  long long offset = first < runs.size() ? runs[first].offset : total;
+  size_t merged = runs.size() - first;
+
+  // The target from offset on is about to be overwritten: first commit a
+  // manifest without those runs, so a crash from here on costs at most sorting
+  // their source records again. runs[0, first) hold source records [0, offset).
+  std::vector<Run> kept(runs.begin(), runs.begin() + first);
+  writeManifest(targetfile, offset, kept);
+  if (merged == 0 && appended > 0)
+  {
+    // Nothing to merge with: append the new run
+    RecordReader<R> input("f3.dat", 0, -1, options.useMmap);
+    RecordWriter<R> output(targetfile, WriteMode::Update, offset);
+    for (; !input.isEmpty(); input.advance())
+      output.write(input.current());
+    output.close();
+  }
+  else if (merged + (appended > 0) > 1)
+  {
+    // Merge the runs into f1.dat. Merged from the first run on, it replaces the
+    // target; otherwise it is copied over the runs it came from.
+    size_t bufferBytes = std::max<size_t>(options.memoryBudget / (merged + 2), IO_ALIGNMENT);
+    std::vector<std::unique_ptr<RecordReader<R>>> readers;
+    for (size_t i = first; i < runs.size(); i++)
+      readers.push_back(std::make_unique<RecordReader<R>>(targetfile, runs[i].offset, runs[i].length, options.useMmap, bufferBytes));
+    readers.push_back(std::make_unique<RecordReader<R>>("f3.dat", 0, -1, options.useMmap, bufferBytes));
+    {
+      RecordWriter<R> output("f1.dat", WriteMode::Truncate, 0, bufferBytes);
+      LoserTree<std::unique_ptr<RecordReader<R>>, Less> tree(readers, less);
+      while (!tree.isEmpty())
+      {
+        output.write(tree.top()->current());
+        tree.pop();
+      }
+      output.close();
+    }
+    readers.clear();
+
+    if (first == 0)
+    {
+      // rename replaces the target atomically
+      if (std::rename("f1.dat", targetfile.c_str()) != 0)
+      {
+        throwSystemError("Error renaming f1.dat to", targetfile);
+      }
+    }
+    else
+    {
+      RecordReader<R> input("f1.dat", 0, -1, options.useMmap, bufferBytes);
+      RecordWriter<R> output(targetfile, WriteMode::Update, offset, bufferBytes);
+      for (; !input.isEmpty(); input.advance())
+        output.write(input.current());
+      output.close();
+    }
+  }
+  std::remove("f1.dat");
+  std::remove("f3.dat");
+
+  runs = kept;
+  if (length > 0)
+    runs.push_back({offset, length});
+  writeManifest(targetfile, n, runs);
+  std::cout << "incremental: " << appended << " new records, " << merged << " runs merged, "
+            << targetfile << " holds " << runs.size() << " runs" << std::endl;
+  return runs.size();
+}
+
+// Reads the manifest of an incrementally sorted target: the number of source
+// records it holds, then one line per run. False if there is none.
+bool readManifest(const std::string &targetfile, long long &sorted, std::vector<Run> &runs)
+{
+  std::ifstream manifest(targetfile + ".runs");
+  if (!manifest)
+    return false;
+  if (!(manifest >> sorted))
+  {
+    throw std::runtime_error("Invalid manifest " + targetfile + ".runs");
+  }
+  runs.clear();
+  for (Run run; manifest >> run.offset >> run.length;)
+    runs.push_back(run);
+  return true;
+}
+
+// Replaces the manifest of a target; the new one is renamed over the old one
+// so that a crash leaves one or the other
+void writeManifest(const std::string &targetfile, long long sorted, const std::vector<Run> &runs)
+{
+  std::string filename = targetfile + ".runs";
+  {
+    std::ofstream manifest(filename + ".tmp");
+    manifest << sorted << "\n";
+    for (const Run &run : runs)
+      manifest << run.offset << " " << run.length << "\n";
+    if (!manifest.flush())
+    {
+      throw std::runtime_error("Error writing " + filename);
+    }
+  }
+  if (std::rename((filename + ".tmp").c_str(), filename.c_str()) != 0)
+  {
+    throw std::runtime_error("Error renaming " + filename + ".tmp");
+  }
+}
+
 // Initializes segments by dividing the original file into smaller runs
 int initializeSegments(int segmentSize, const std::string &originalFile, const std::string &f1)
 {
   std::vector<int> list(segmentSize);
-  std::ifstream input(originalFile, std::ios::binary);
-  std::ofstream output(f1, std::ios::binary);
+  RecordReader<int> input(originalFile);
+  RecordWriter<int> output(f1);
 
   int numberOfSegments = 0;
-  while (input)
+  while (size_t i = input.read(list.data(), segmentSize))
   {
     numberOfSegments++;
-    int i = 0;
-    for (; input && i < segmentSize; i++)
+    std::sort(list.begin(), list.begin() + i);
+    output.write(list.data(), i);
+  }
+  output.close();
+  return numberOfSegments;
+}
+
+// Cuts the records [first, first + length) of the original file (all of it by
+// default) into sorted runs of at most runSize records
+template <typename R, typename RunWriter, typename Less>
+std::vector<Run> createRuns(const std::string &sourcefile, const std::string &runfile, size_t runSize, bool useMmap, Less less,
+                            long long first, long long length)
+{
+  RecordReader<R> input(sourcefile, first, length, useMmap);
+  RunWriter output(runfile);
+
+  std::vector<R> list(runSize);
+  std::vector<Run> runs;
+  while (long long count = input.read(list.data(), runSize))
+  {
+    std::sort(list.begin(), list.begin() + count, less);
+    runs.push_back({output.position(), count});
+    output.write(list.data(), count);
+  }
+  output.close();
+  return runs;
+}
+
+// Two d-ary min-heaps sharing one array of capacity records, for replacement
+// selection: the heap of the current run grows from one end of the array and
+// the heap of the next run from the other, so records need no run tag and the
+// array holds as many records as the memory allows. Once the current heap is
+// empty the next one takes its place.
+template <typename R, typename Less, size_t Arity = DEFAULT_HEAP_ARITY>
+class RunHeaps
+{
+public:
+  RunHeaps(size_t capacity, Less less) : data(capacity), less(less) {}
+
+  size_t currentSize() const
+  {
+    return current.size;
+  }
+
+  bool isFull() const
+  {
+    return current.size + next.size == data.size();
+  }
+
+  // The smallest record of the current run
+  const R &top() const
+  {
+    return at(current, 0);
+  }
+
+  void pushCurrent(R value)
+  {
+    push(current, std::move(value));
+  }
+
+  // Adds a record for the next run; there must be room
+  void pushNext(R value)
+  {
+    push(next, std::move(value));
+  }
+
+  void replaceTop(R value)
+  {
+    at(current, 0) = std::move(value);
+    siftDown(current, 0);
+  }
+
+  void popTop()
+  {
+    current.size--;
+    if (current.size > 0)
     {
-      input.read(reinterpret_cast<char *>(&list[i]), sizeof(int));
+      at(current, 0) = std::move(at(current, current.size));
+      siftDown(current, 0);
     }
+  }
 
-    std::sort(list.begin(), list.begin() + i);
+  // Makes the heap of the next run the current one
+  void startNextRun()
+  {
+    std::swap(current, next);
+  }
 
-    for (int j = 0; j < i; j++)
+private:
+  // A heap of size records stored from the front of the array or, reversed, from its back
+  struct Side
+  {
+    size_t size;
+    bool front;
+  };
+
+  std::vector<R> data;
+  Less less;
+  Side current{0, true}, next{0, false};
+
+  R &at(const Side &side, size_t index)
+  {
+    return data[side.front ? index : data.size() - 1 - index];
+  }
+
+  const R &at(const Side &side, size_t index) const
+  {
+    return data[side.front ? index : data.size() - 1 - index];
+  }
+
+  void push(Side &side, R value)
+  {
+    size_t index = side.size++;
+    while (index > 0)
+    {
+      size_t parentIndex = (index - 1) / Arity;
+      if (!less(value, at(side, parentIndex)))
+        break;
+      at(side, index) = std::move(at(side, parentIndex));
+      index = parentIndex;
+    }
+    at(side, index) = std::move(value);
+  }
+
+  void siftDown(const Side &side, size_t index)
+  {
+    R value = std::move(at(side, index));
+    while (true)
+    {
+      size_t firstChild = Arity * index + 1;
+      if (firstChild >= side.size)
+        break;
+      size_t lastChild = std::min(firstChild + Arity, side.size);
+      size_t smallestChild = firstChild;
+      for (size_t child = firstChild + 1; child < lastChild; child++)
+      {
+        if (less(at(side, child), at(side, smallestChild)))
+          smallestChild = child;
+      }
+      if (!less(at(side, smallestChild), value))
+        break;
+      at(side, index) = std::move(at(side, smallestChild));
+      index = smallestChild;
+    }
+    at(side, index) = std::move(value);
+  }
+};
+
+// Replacement selection: a heap of heapSize records keeps emitting the smallest
+// record that still fits into the current run; records smaller than the last
+// one written go to the heap of the next run, which fills the space the current
+// heap gives up. Random input gives runs of about 2 * heapSize records, partly
+// sorted input gives much longer runs.
+template <typename R, typename RunWriter, typename Less>
+std::vector<Run> createRunsReplacementSelection(const std::string &sourcefile, const std::string &runfile, size_t heapSize, bool useMmap, Less less,
+                                                long long first, long long length)
+{
+  RecordReader<R> input(sourcefile, first, length, useMmap);
+  RunWriter output(runfile);
+
+  RunHeaps<R, Less> heaps(heapSize, less);
+  R value;
+  while (!heaps.isFull() && input.read(value))
+    heaps.pushCurrent(value);
+
+  std::vector<Run> runs;
+  long long offset = 0, runLength = 0;
+  while (heaps.currentSize() > 0)
+  {
+    R top = heaps.top();
+    output.write(top);
+    runLength++;
+
+    if (!input.read(value))
+    {
+      heaps.popTop();
+    }
+    else if (less(value, top))
+    {
+      heaps.popTop();
+      heaps.pushNext(value);
+    }
+    else
     {
-      output.write(reinterpret_cast<const char *>(&list[j]), sizeof(int));
+      heaps.replaceTop(value);
+    }
+
+    if (heaps.currentSize() == 0)
+    {
+      runs.push_back({offset, runLength});
+      offset = output.position();
+      runLength = 0;
+      heaps.startNextRun();
     }
   }
-  input.close();
   output.close();
-  return numberOfSegments;
+  return runs;
+}
+
+// Thread-safe FIFO queue; pop() returns false once the queue is closed and drained
+template <typename T>
+class BlockingQueue
+{
+public:
+  void push(T value)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      items.push(std::move(value));
+    }
+    ready.notify_one();
+  }
+
+  bool pop(T &value)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    ready.wait(lock, [this] { return !items.empty() || closed; });
+    if (items.empty())
+      return false;
+    value = std::move(items.front());
+    items.pop();
+    return true;
+  }
+
+  void close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    ready.notify_all();
+  }
+
+private:
+  std::queue<T> items;
+  std::mutex mutex;
+  std::condition_variable ready;
+  bool closed = false;
+};
+
+// Runs fn(0..count-1) on count threads and rethrows the first exception
+template <typename Function>
+void runThreads(int count, Function fn)
+{
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> errors(count);
+  for (int i = 0; i < count; i++)
+  {
+    threads.emplace_back([&, i] {
+      try
+      {
+        fn(i);
+      }
+      catch (...)
+      {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+  for (auto &error : errors)
+  {
+    if (error)
+      std::rethrow_exception(error);
+  }
+}
+
+// Pipelined run formation over PIPELINE_BUFFERS buffers: one reader thread
+// fills a buffer, a pool of workers sorts slices of it in parallel and one
+// writer thread merges the sorted slices into a run, so reading, sorting and
+// writing overlap. The buffers in flight do not depend on the thread count.
+// If any thread fails, all queues are closed so the others stop and the error
+// is reported.
+template <typename R, typename RunWriter, typename Less>
+std::vector<Run> createRunsParallel(const std::string &sourcefile, const std::string &runfile, size_t runSize, int threads, bool useMmap, Less less,
+                                    long long first, long long length)
+{
+  RecordReader<R> input(sourcefile, first, length, useMmap);
+  RunWriter output(runfile);
+
+  // A buffer cut into slices, sorted independently
+  struct Job
+  {
+    size_t buffer;
+    long long count;
+  };
+  struct Slice
+  {
+    size_t buffer;
+    long long first, last;
+  };
+  const int slices = static_cast<int>(std::min<long long>(threads, std::max<size_t>(runSize, 1)));
+  std::vector<std::vector<R>> buffers(PIPELINE_BUFFERS, std::vector<R>(runSize));
+  std::vector<long long> counts(PIPELINE_BUFFERS);
+  std::unique_ptr<std::atomic<int>[]> slicesLeft(new std::atomic<int>[PIPELINE_BUFFERS]);
+  BlockingQueue<size_t> freeBuffers;
+  BlockingQueue<Slice> toSort;
+  BlockingQueue<Job> toWrite;
+  for (size_t i = 0; i < buffers.size(); i++)
+    freeBuffers.push(i);
+
+  std::atomic<bool> failed(false);
+  auto abort = [&] {
+    failed = true;
+    freeBuffers.close();
+    toSort.close();
+    toWrite.close();
+  };
+
+  std::vector<Run> runs;
+  std::atomic<int> sorters(threads);
+  runThreads(threads + 2, [&](int id) {
+    try
+    {
+      if (id == 0)
+      {
+        // Reader
+        size_t buffer;
+        while (!failed && freeBuffers.pop(buffer))
+        {
+          long long count = input.read(buffers[buffer].data(), runSize);
+          if (count == 0)
+            break;
+          counts[buffer] = count;
+          slicesLeft[buffer] = slices;
+          for (int i = 0; i < slices; i++)
+            toSort.push({buffer, count * i / slices, count * (i + 1) / slices});
+        }
+        toSort.close();
+      }
+      else if (id == 1)
+      {
+        // Writer: merges the slices of a buffer into one run; runs are appended in completion order
+        Job job;
+        while (!failed && toWrite.pop(job))
+        {
+          auto data = buffers[job.buffer].begin();
+          std::vector<std::pair<decltype(data), decltype(data)>> ranges;
+          for (int i = 0; i < slices; i++)
+            ranges.emplace_back(data + job.count * i / slices, data + job.count * (i + 1) / slices);
+          runs.push_back({output.position(), job.count});
+          for (KWayMerge<decltype(data), Less> merge(ranges, less); !merge.isEmpty(); merge.advance())
+            output.write(merge.current());
+          freeBuffers.push(job.buffer);
+        }
+        freeBuffers.close();
+      }
+      else
+      {
+        // Sorter: the last slice of a buffer sends it to the writer
+        Slice slice;
+        while (!failed && toSort.pop(slice))
+        {
+          auto data = buffers[slice.buffer].begin();
+          std::sort(data + slice.first, data + slice.last, less);
+          if (--slicesLeft[slice.buffer] == 0)
+            toWrite.push({slice.buffer, counts[slice.buffer]});
+        }
+        if (--sorters == 0)
+          toWrite.close();
+      }
+    }
+    catch (...)
+    {
+      abort();
+      throw;
+    }
+  });
+  output.close();
+  return runs;
+}
+
+// Merges groups of up to fanIn runs per pass, ping-ponging between f1 and f2,
+// until a single run is left in targetfile. The groups of a pass are independent
+// and are merged by up to threads workers into disjoint parts of the output file.
+// The runs are read with RunReader and, except in the target, written with
+// RunWriter. Packed runs have no fixed size, so each merged run gets room for
+// its worst case; the unused rest stays a hole in the file.
+template <typename R, typename RunReader, typename RunWriter, typename Less>
+void xmergeKWay(std::vector<Run> runs, const SortOptions &options, const std::string &f1, const std::string &f2, const std::string &targetfile, Less less)
+{
+  const size_t fanIn = options.fanIn;
+  if (options.fanIn < 2)
+  {
+    throw std::invalid_argument("fan-in must be at least 2");
+  }
+
+  std::string input = f1, output = f2;
+  int passes = 0;
+  while (runs.size() > 1)
+  {
+    // The last pass writes straight into the target file
+    bool lastPass = runs.size() <= fanIn;
+    std::string outputfile = lastPass ? targetfile : output;
+    RecordWriter<R>(outputfile).close(); // create or truncate
+
+    std::vector<Run> merged;
+    long long offset = 0;
+    for (size_t first = 0; first < runs.size(); first += fanIn)
+    {
+      size_t last = std::min(first + fanIn, runs.size());
+      long long length = 0;
+      for (size_t i = first; i < last; i++)
+        length += runs[i].length;
+      merged.push_back({offset, length});
+      if constexpr (std::is_same<RunWriter, PackedRunWriter>::value)
+        offset += lastPass ? length : packedWordsBound(length);
+      else
+        offset += length;
+    }
+
+    // Each worker gets an equal share of the memory budget: one buffer per
+    // input run plus one for the output
+    size_t k = std::min(runs.size(), fanIn);
+    int workers = static_cast<int>(std::min<size_t>(options.threads, merged.size()));
+    size_t bufferBytes = std::max<size_t>(options.memoryBudget / workers / (k + 1), IO_ALIGNMENT);
+
+    std::atomic<size_t> nextGroup(0);
+    runThreads(workers, [&](int) {
+      for (size_t group; (group = nextGroup++) < merged.size();)
+      {
+        size_t first = group * fanIn;
+        size_t last = std::min(first + fanIn, runs.size());
+        if (lastPass)
+        {
+          RecordWriter<R> out(outputfile, WriteMode::Update, merged[group].offset, bufferBytes);
+          mergeRuns<RunReader>(input, runs, first, last, bufferBytes, options.useMmap, out, less);
+          out.close();
+        }
+        else
+        {
+          RunWriter out(outputfile, WriteMode::Update, merged[group].offset, bufferBytes);
+          mergeRuns<RunReader>(input, runs, first, last, bufferBytes, options.useMmap, out, less);
+          out.close();
+        }
+      }
+    });
+
+    runs = merged;
+    passes++;
+    if (lastPass)
+      break;
+    std::swap(input, output);
+  }
+
+  if (passes == 0 && std::is_same<RunReader, RecordReader<R>>::value)
+  {
+    // Zero or one run: the run file already is the result; rename replaces the target atomically
+    if (std::rename(input.c_str(), targetfile.c_str()) != 0)
+    {
+      throwSystemError("Error renaming " + input + " to", targetfile);
+    }
+  }
+  else if (passes == 0)
+  {
+    // A packed run still has to be unpacked
+    RecordWriter<R> out(targetfile);
+    mergeRuns<RunReader>(input, runs, 0, runs.size(), DEFAULT_IO_BUFFER_BYTES, options.useMmap, out, less);
+    out.close();
+  }
+  std::remove(f1.c_str());
+  std::remove(f2.c_str());
+
+  std::cout << "k-way merge: " << passes << " merge passes" << std::endl;
+}
+
+// Merges runs[first, last) of the input file into the output
+template <typename RunReader, typename Output, typename Less>
+void mergeRuns(const std::string &inputfile, const std::vector<Run> &runs, size_t first, size_t last, size_t bufferBytes, bool useMmap, Output &output, Less less)
+{
+  std::vector<std::unique_ptr<RunReader>> readers;
+  for (size_t i = first; i < last; i++)
+  {
+    readers.push_back(std::make_unique<RunReader>(inputfile, runs[i].offset, runs[i].length, useMmap, bufferBytes));
+  }
+
+  LoserTree<std::unique_ptr<RunReader>, Less> tree(readers, less);
+  while (!tree.isEmpty())
+  {
+    output.write(tree.top()->current());
+    tree.pop();
+  }
 }
 
 // Merges segments recursively
@@ -88,91 +956,82 @@ void xmerge(int numberOfSegments, int segmentSize, const std::string &f1, const
 // Merges two segments in one step
 void mergeOneStep(int numberOfSegments, int segmentSize, const std::string &f1, const std::string &f2, const std::string &f3)
 {
-  std::ifstream f1Input(f1, std::ios::binary);
-  std::ofstream f2Output(f2, std::ios::binary);
+  RecordReader<int> f1Input(f1);
+  RecordWriter<int> f2Output(f2);
 
   copyHalfToF2(numberOfSegments, segmentSize, f1Input, f2Output);
   f2Output.close();
 
-  std::ifstream f2Input(f2, std::ios::binary);
-  std::ofstream f3Output(f3, std::ios::binary);
+  RecordReader<int> f2Input(f2);
+  RecordWriter<int> f3Output(f3);
 
   mergeSegments(numberOfSegments / 2, segmentSize, f1Input, f2Input, f3Output);
 
-  f1Input.close();
-  f2Input.close();
   f3Output.close();
 }
 
 // Copies half of the data from f1 to f2
-void copyHalfToF2(int numberOfSegments, int segmentSize, std::ifstream &f1, std::ofstream &f2)
+void copyHalfToF2(int numberOfSegments, int segmentSize, RecordReader<int> &f1, RecordWriter<int> &f2)
 {
-  for (int i = 0; i < (numberOfSegments / 2) * segmentSize; i++)
+  std::vector<int> block(BUFFER_SIZE);
+  long long remaining = static_cast<long long>(numberOfSegments / 2) * segmentSize;
+  while (remaining > 0)
   {
-    int value;
-    f1.read(reinterpret_cast<char *>(&value), sizeof(int));
-    f2.write(reinterpret_cast<const char *>(&value), sizeof(int));
+    size_t count = f1.read(block.data(), std::min<long long>(remaining, block.size()));
+    if (count == 0)
+      break;
+    f2.write(block.data(), count);
+    remaining -= count;
   }
 }
 
 // Merges segments from f1 and f2 into f3
-void mergeSegments(int numberOfSegments, int segmentSize, std::ifstream &f1, std::ifstream &f2, std::ofstream &f3)
+void mergeSegments(int numberOfSegments, int segmentSize, RecordReader<int> &f1, RecordReader<int> &f2, RecordWriter<int> &f3)
 {
   for (int i = 0; i < numberOfSegments; i++)
   {
     mergeTwoSegments(segmentSize, f1, f2, f3);
   }
 
-  while (f1)
+  int value;
+  while (f1.read(value))
   {
-    int value;
-    f1.read(reinterpret_cast<char *>(&value), sizeof(int));
-    f3.write(reinterpret_cast<const char *>(&value), sizeof(int));
+    f3.write(value);
   }
 }
 
 // Merges two segments
-void mergeTwoSegments(int segmentSize, std::ifstream& f1, std::ifstream& f2, std::ofstream& f3) {
-  int intFromF1, intFromF2;
-  int f1Count = 1, f2Count = 1;
-
-  // Read the first elements from each file
-  f1.read(reinterpret_cast<char*>(&intFromF1), sizeof(int));
-  f2.read(reinterpret_cast<char*>(&intFromF2), sizeof(int));
+void mergeTwoSegments(int segmentSize, RecordReader<int> &f1, RecordReader<int> &f2, RecordWriter<int> &f3)
+{
+  int f1Count = 0, f2Count = 0;
 
   // Merge segments while data available in both files
-  while (true) {
-    if (intFromF1 < intFromF2) {
-      f3.write(reinterpret_cast<char*>(&intFromF1), sizeof(int));
+  while (f1Count < segmentSize && !f1.isEmpty() && f2Count < segmentSize && !f2.isEmpty())
+  {
+    if (f1.current() < f2.current())
+    {
+      f3.write(f1.current());
+      f1.advance();
       f1Count++;
-      if (f1Count >= segmentSize || f1.peek() == EOF) {
-        f3.write(reinterpret_cast<char*>(&intFromF2), sizeof(int));
-        break;
-      }else
-        f1.read(reinterpret_cast<char*>(&intFromF1), sizeof(int));
-    } else {
-      f3.write(reinterpret_cast<char*>(&intFromF2), sizeof(int));
+    }
+    else
+    {
+      f3.write(f2.current());
+      f2.advance();
       f2Count++;
-      if (f2Count >= segmentSize || f2.peek() == EOF) {
-        f3.write(reinterpret_cast<char*>(&intFromF1), sizeof(int));
-        break;
-      }else
-        f2.read(reinterpret_cast<char*>(&intFromF2), sizeof(int));
     }
   }
 
   // Write remaining elements from f1 (if any)
-  while (f1Count < segmentSize && f1.peek() != EOF) {
-    f1.read(reinterpret_cast<char*>(&intFromF1), sizeof(int));
-    f3.write(reinterpret_cast<char*>(&intFromF1), sizeof(int));
-    f1Count++;
+  for (int value; f1Count < segmentSize && f1.read(value); f1Count++)
+  {
+    f3.write(value);
   }
 
   // Write remaining elements from f2 (if any)
-  while (f2Count < segmentSize && f2.peek() != EOF) {
-    f2.read(reinterpret_cast<char*>(&intFromF2), sizeof(int));
-    f3.write(reinterpret_cast<char*>(&intFromF2), sizeof(int));
-    f2Count++;
+  for (int value; f2Count < segmentSize && f2.read(value); f2Count++)
+  {
+    f3.write(value);
   }
 }
 
@@ -180,20 +1039,181 @@ void mergeTwoSegments(int segmentSize, std::ifstream& f1, std::ifstream& f2, std
 // Displays the first 100 numbers from the sorted file
 void displayFile(const std::string &filename)
 {
-  std::ifstream input(filename, std::ios::binary);
-  if (!input)
+  std::vector<int> values(100);
+  values.resize(RecordReader<int>(filename).read(values.data(), values.size()));
+  for (int value : values)
   {
-    std::cerr << "Error opening " << filename << std::endl;
-    return;
+    std::cout << value << " ";
   }
+  std::cout << std::endl;
+}
 
-  int value;
-  for (int i = 0; i < 100; i++)
+// Order-independent hash of a multiset of records: the sums of two different
+// 64-bit hashes of every record's bytes. Equal multisets give equal sums in
+// any order; a lost, duplicated or changed record changes both sums.
+struct MultisetHash
+{
+  uint64_t sum1 = 0, sum2 = 0;
+
+  template <typename R>
+  void add(const R &record)
   {
-    if (input.read(reinterpret_cast<char *>(&value), sizeof(int)))
+    // Mix the record 8 bytes at a time, then finish with two different finalizers
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&record);
+    uint64_t h = sizeof(R);
+    for (size_t i = 0; i < sizeof(R); i += 8)
     {
-      std::cout << value << " ";
+      uint64_t word = 0;
+      std::memcpy(&word, bytes + i, std::min<size_t>(8, sizeof(R) - i));
+      h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+      h ^= h >> 32;
     }
+    sum1 += mix(h, 0xbf58476d1ce4e5b9ULL);
+    sum2 += mix(h, 0x94d049bb133111ebULL);
+  }
+
+  void add(const MultisetHash &other)
+  {
+    sum1 += other.sum1;
+    sum2 += other.sum2;
+  }
+
+  bool operator==(const MultisetHash &other) const
+  {
+    return sum1 == other.sum1 && sum2 == other.sum2;
+  }
+
+private:
+  static uint64_t mix(uint64_t h, uint64_t multiplier)
+  {
+    h = (h ^ (h >> 30)) * multiplier;
+    h = (h ^ (h >> 27)) * 0xc2b2ae3d27d4eb4fULL;
+    return h ^ (h >> 31);
+  }
+};
+
+// What a thread found in its chunk of the target
+struct ChunkCheck
+{
+  MultisetHash hash;
+  long long firstUnsorted = -1; // record that is less than the one before it
+};
+
+// Verifies in one pass over each file that the target is sorted and holds the
+// same records as the source. Both files are cut into chunks that threads map
+// and scan; a chunk of the target also reads the record before it, so the
+// boundaries between chunks are checked too.
+template <typename R, typename Less>
+bool verifySort(const std::string &sourcefile, const std::string &targetfile, int threads, Less less)
+{
+  long long sourceRecords = countRecords<R>(sourcefile), targetRecords = countRecords<R>(targetfile);
+  const long long chunks = 4LL * threads;
+
+  std::vector<MultisetHash> sourceHashes(chunks);
+  std::vector<ChunkCheck> targetChecks(chunks);
+  std::atomic<long long> nextChunk{0};
+  runThreads(threads, [&](int) {
+    // Chunks 0..chunks-1 are in the source, chunks..2*chunks-1 in the target
+    for (long long task; (task = nextChunk++) < 2 * chunks;)
+    {
+      bool target = task >= chunks;
+      long long chunk = task % chunks, records = target ? targetRecords : sourceRecords;
+      long long first = records * chunk / chunks, last = records * (chunk + 1) / chunks;
+      if (!target)
+      {
+        RecordReader<R> input(sourcefile, first, last - first, true);
+        for (; !input.isEmpty(); input.advance())
+          sourceHashes[chunk].add(input.current());
+        continue;
+      }
+
+      ChunkCheck &check = targetChecks[chunk];
+      long long start = std::max(first - 1, 0LL);
+      RecordReader<R> input(targetfile, start, last - start, true);
+      if (input.isEmpty())
+        continue;
+      R previous = input.current();
+      if (start == first)
+        check.hash.add(previous);
+      input.advance();
+      for (long long i = start + 1; !input.isEmpty(); input.advance(), i++)
+      {
+        const R &value = input.current();
+        check.hash.add(value);
+        if (check.firstUnsorted < 0 && less(value, previous))
+          check.firstUnsorted = i;
+        previous = value;
+      }
+    }
+  });
+
+  MultisetHash sourceHash, targetHash;
+  long long firstUnsorted = -1;
+  for (long long chunk = 0; chunk < chunks; chunk++)
+  {
+    sourceHash.add(sourceHashes[chunk]);
+    targetHash.add(targetChecks[chunk].hash);
+    if (firstUnsorted < 0)
+      firstUnsorted = targetChecks[chunk].firstUnsorted;
+  }
+
+  bool ok = true;
+  if (sourceRecords != targetRecords)
+  {
+    std::cout << "verify: " << sourceRecords << " records in " << sourcefile << " but " << targetRecords << " in " << targetfile << std::endl;
+    ok = false;
+  }
+  else if (!(sourceHash == targetHash))
+  {
+    std::cout << "verify: " << targetfile << " is not a permutation of " << sourcefile << std::endl;
+    ok = false;
+  }
+  if (firstUnsorted >= 0)
+  {
+    std::cout << "verify: " << targetfile << " is out of order at record " << firstUnsorted << std::endl;
+    ok = false;
+  }
+  if (ok)
+    std::cout << "verify: " << targetfile << " is sorted and holds the " << targetRecords << " records of " << sourcefile << std::endl;
+  return ok;
+}
+
+// Reads the command line options
+SortOptions parseOptions(int argc, char *argv[], std::string &sourcefile, std::string &targetfile)
+{
+  SortOptions options;
+  int positional = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "--balanced")
+      options.kway = false;
+    else if (arg.rfind("--fan-in=", 0) == 0)
+      options.fanIn = std::stoi(arg.substr(9));
+    else if (arg.rfind("--memory=", 0) == 0)
+      options.memoryBudget = std::stoull(arg.substr(9)) * 1024 * 1024;
+    else if (arg.rfind("--threads=", 0) == 0)
+      options.threads = std::max(1, std::stoi(arg.substr(10)));
+    else if (arg == "--replacement-selection")
+      options.replacementSelection = true;
+    else if (arg == "--mmap")
+      options.useMmap = true;
+    else if (arg == "--events")
+      options.events = true;
+    else if (arg == "--verify")
+      options.verify = true;
+    else if (arg == "--verify-only")
+      options.verifyOnly = true;
+    else if (arg == "--incremental")
+      options.incremental = true;
+    else if (arg == "--compact")
+      options.incremental = options.compact = true;
+    else if (arg == "--compress")
+      options.compress = true;
+    else if (positional++ == 0)
+      sourcefile = arg;
+    else
+      targetfile = arg;
   }
-  input.close();
+  return options;
 }
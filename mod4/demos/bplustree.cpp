@@ -0,0 +1,96 @@
+// Compares point lookups and range scans of the B+-tree in bplustree.h with std::map
+// Build: g++ -std=c++17 -O2 -mavx2 bplustree.cpp
+// Usage: bplustree [number of keys, default 1e6] [number of lookups, default 1e6]
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "bplustree.h"
+
+// Runs work and prints ns per operation
+template <typename Work>
+void timed(const std::string &name, size_t operations, Work work)
+{
+  auto start = std::chrono::steady_clock::now();
+  work();
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / operations;
+  std::cout << name << ": " << ns << " ns/op" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t n = argc > 1 ? static_cast<size_t>(std::stod(argv[1])) : 1000000;
+  size_t m = argc > 2 ? static_cast<size_t>(std::stod(argv[2])) : 1000000;
+
+  // Random keys, and lookups that hit and miss
+  std::mt19937 rng(42);
+  std::vector<int> keys(n), queries(m);
+  for (auto &key : keys)
+    key = rng() % (4 * n + 1);
+  for (auto &query : queries)
+    query = rng() % (4 * n + 2);
+
+  BPlusTree<int, int> tree;
+  std::map<int, int> map;
+  timed("B+-tree insert", n, [&] {
+    for (int key : keys)
+      tree.insert(key, -key);
+  });
+  timed("std::map insert", n, [&] {
+    for (int key : keys)
+      map[key] = -key;
+  });
+  std::cout << tree.size() << " keys, height " << tree.height() << ", " << tree.LEAF_CAPACITY << " keys per leaf, "
+            << tree.INNER_CAPACITY << " per inner node" << std::endl;
+
+  long long treeSum = 0, mapSum = 0;
+  timed("B+-tree lookup", m, [&] {
+    for (int query : queries)
+    {
+      const int *value = tree.find(query);
+      treeSum += value != nullptr ? *value : 1;
+    }
+  });
+  timed("std::map lookup", m, [&] {
+    for (int query : queries)
+    {
+      auto it = map.find(query);
+      mapSum += it != map.end() ? it->second : 1;
+    }
+  });
+
+  // Range scans over about 100 keys each
+  long long treeRange = 0, mapRange = 0;
+  size_t scans = m / 100 + 1;
+  timed("B+-tree range scan", scans, [&] {
+    for (size_t i = 0; i < scans; i++)
+      tree.scan(queries[i], queries[i] + 400, [&](int, int value) { treeRange += value; });
+  });
+  timed("std::map range scan", scans, [&] {
+    for (size_t i = 0; i < scans; i++)
+    {
+      for (auto it = map.lower_bound(queries[i]); it != map.end() && it->first < queries[i] + 400; ++it)
+        mapRange += it->second;
+    }
+  });
+
+  // Erase every other key
+  for (size_t i = 0; i < n; i += 2)
+  {
+    if (tree.erase(keys[i]) != (map.erase(keys[i]) == 1))
+      treeSum++;
+  }
+
+  bool same = treeSum == mapSum && treeRange == mapRange && tree.size() == map.size();
+  auto it = tree.begin();
+  for (const auto &entry : map)
+  {
+    same = same && it != tree.end() && it.key() == entry.first && it.value() == entry.second;
+    ++it;
+  }
+  std::cout << (same && it == tree.end() ? "B+-tree and std::map agree" : "Wrong answers") << std::endl;
+  return same ? 0 : 1;
+}
@@ -0,0 +1,527 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+// Cache-conscious B+-tree map. Unlike BTree in btree.h, whose nodes keep
+// their keys and children in two heap-allocated vectors, a node here is one
+// fixed-size block of NodeBytes with its keys inline, so visiting a node
+// touches a few adjacent cache lines and inserting allocates only on a split.
+// - values live only in the leaves; inner nodes hold separator keys
+// - leaves are linked both ways, so range scans walk the leaf level
+// - a node is searched by counting the keys less than the query: with AVX2 and
+//   int keys eight at a time, otherwise with a branchless scan
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+const size_t BPLUS_CACHE_LINE = 64;
+
+template <typename Key, typename Value, size_t NodeBytes = 256, typename Compare = std::less<Key>>
+class BPlusTree
+{
+  static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                "keys and values are stored inline in the nodes");
+
+  struct alignas(BPLUS_CACHE_LINE) Node
+  {
+    uint32_t count = 0; // keys in the node
+    bool leaf;
+
+    explicit Node(bool leaf) : leaf(leaf) {}
+  };
+
+  // int keys are searched 8 at a time, so their arrays hold whole blocks of 8
+  static constexpr size_t KEY_BLOCK = std::is_same<Key, int>::value ? 8 : 1;
+
+  static constexpr size_t keySlots(size_t capacity)
+  {
+    return (capacity + KEY_BLOCK - 1) / KEY_BLOCK * KEY_BLOCK;
+  }
+
+  // The most keys (at least 4) whose node, with linkBytes of links and
+  // entryBytes more per key, fits in NodeBytes
+  static constexpr size_t capacity(size_t linkBytes, size_t entryBytes)
+  {
+    size_t keys = std::max<size_t>((NodeBytes - 8 - linkBytes) / (sizeof(Key) + entryBytes), 4);
+    while (keys > 4 && 8 + linkBytes + keySlots(keys) * sizeof(Key) + keys * entryBytes > NodeBytes)
+      keys--;
+    return keys;
+  }
+
+public:
+  // Keys per node; the header and the links take the rest of the NodeBytes
+  static constexpr size_t LEAF_CAPACITY = capacity(2 * sizeof(void *), sizeof(Value));
+  static constexpr size_t INNER_CAPACITY = capacity(sizeof(void *), sizeof(void *));
+
+private:
+  // Key slots past the capacity are zero and never count: search masks them out
+  struct Leaf : Node
+  {
+    Key keys[keySlots(LEAF_CAPACITY)] = {};
+    Value values[LEAF_CAPACITY];
+    Leaf *prev = nullptr, *next = nullptr;
+
+    Leaf() : Node(true) {}
+  };
+
+  // children[i] holds the keys in [keys[i - 1], keys[i])
+  struct Inner : Node
+  {
+    Key keys[keySlots(INNER_CAPACITY)] = {};
+    Node *children[INNER_CAPACITY + 1];
+
+    Inner() : Node(false) {}
+  };
+
+  static constexpr size_t LEAF_MIN = LEAF_CAPACITY / 2;
+  static constexpr size_t INNER_MIN = INNER_CAPACITY / 2;
+
+public:
+  // Forward iterator over (key, value) in key order along the leaf links
+  class const_iterator
+  {
+  public:
+    const Key &key() const
+    {
+      return leaf->keys[index];
+    }
+
+    const Value &value() const
+    {
+      return leaf->values[index];
+    }
+
+    const_iterator &operator++()
+    {
+      if (++index == leaf->count)
+      {
+        leaf = leaf->next;
+        index = 0;
+      }
+      return *this;
+    }
+
+    bool operator==(const const_iterator &other) const
+    {
+      return leaf == other.leaf && index == other.index;
+    }
+
+    bool operator!=(const const_iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class BPlusTree;
+    const Leaf *leaf = nullptr;
+    size_t index = 0;
+
+    const_iterator(const Leaf *leaf, size_t index) : leaf(leaf), index(index) {}
+
+  public:
+    const_iterator() = default;
+  };
+
+  explicit BPlusTree(Compare comp = Compare()) : root(new Leaf()), comp(comp) {}
+
+  BPlusTree(const BPlusTree &) = delete;
+  BPlusTree &operator=(const BPlusTree &) = delete;
+
+  ~BPlusTree()
+  {
+    destroy(root);
+  }
+
+  size_t size() const
+  {
+    return n;
+  }
+
+  int height() const
+  {
+    int h = 1;
+    for (const Node *node = root; !node->leaf; node = static_cast<const Inner *>(node)->children[0])
+      h++;
+    return h;
+  }
+
+  // The value of key, or nullptr
+  const Value *find(const Key &key) const
+  {
+    const Leaf *leaf = findLeaf(key);
+    size_t i = rankLess(leaf->keys, leaf->count, key);
+    return i < leaf->count && !comp(key, leaf->keys[i]) ? &leaf->values[i] : nullptr;
+  }
+
+  bool contains(const Key &key) const
+  {
+    return find(key) != nullptr;
+  }
+
+  // Inserts key or replaces its value; true if the key is new
+  bool insert(const Key &key, const Value &value)
+  {
+    Key separator;
+    bool added = false;
+    Node *right = insert(root, key, value, separator, added);
+    if (right != nullptr)
+    {
+      // The root split: the tree grows by one level
+      Inner *newRoot = new Inner();
+      newRoot->count = 1;
+      newRoot->keys[0] = separator;
+      newRoot->children[0] = root;
+      newRoot->children[1] = right;
+      root = newRoot;
+    }
+    n += added;
+    return added;
+  }
+
+  // Removes key; true if it was there
+  bool erase(const Key &key)
+  {
+    if (!erase(root, key))
+      return false;
+    n--;
+    if (!root->leaf && root->count == 0)
+    {
+      // The root lost its last separator: its only child takes over
+      Inner *old = static_cast<Inner *>(root);
+      root = old->children[0];
+      delete old;
+    }
+    return true;
+  }
+
+  const_iterator begin() const
+  {
+    const Node *node = root;
+    while (!node->leaf)
+      node = static_cast<const Inner *>(node)->children[0];
+    const Leaf *leaf = static_cast<const Leaf *>(node);
+    return leaf->count > 0 ? const_iterator(leaf, 0) : end();
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator();
+  }
+
+  // First element whose key is not less than key
+  const_iterator lowerBound(const Key &key) const
+  {
+    const Leaf *leaf = findLeaf(key);
+    size_t i = rankLess(leaf->keys, leaf->count, key);
+    if (i == leaf->count)
+      return leaf->next != nullptr ? const_iterator(leaf->next, 0) : end();
+    return const_iterator(leaf, i);
+  }
+
+  // Calls visit(key, value) for the keys in [lo, hi) in order
+  template <typename Visit>
+  void scan(const Key &lo, const Key &hi, Visit visit) const
+  {
+    for (const_iterator it = lowerBound(lo); it != end() && comp(it.key(), hi); ++it)
+      visit(it.key(), it.value());
+  }
+
+private:
+  Node *root;
+  size_t n = 0;
+  Compare comp;
+
+  // Number of the first count keys less than key
+  size_t rankLess(const Key *keys, size_t count, const Key &key) const
+  {
+#ifdef __AVX2__
+    if constexpr (simdKeys)
+    {
+      __m256i x = _mm256_set1_epi32(key);
+      size_t rank = 0;
+      for (size_t i = 0; i < count; i += 8)
+      {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        unsigned mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(x, block)));
+        rank += __builtin_popcount(mask & lanes(count - i));
+      }
+      return rank;
+    }
+#endif
+    size_t rank = 0;
+    for (size_t i = 0; i < count; i++)
+      rank += comp(keys[i], key);
+    return rank;
+  }
+
+  // Number of the first count keys not greater than key: the child to descend into
+  size_t rankLessEqual(const Key *keys, size_t count, const Key &key) const
+  {
+#ifdef __AVX2__
+    if constexpr (simdKeys)
+    {
+      __m256i x = _mm256_set1_epi32(key);
+      size_t rank = 0;
+      for (size_t i = 0; i < count; i += 8)
+      {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(keys + i));
+        unsigned greater = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(block, x)));
+        rank += __builtin_popcount(~greater & lanes(count - i));
+      }
+      return rank;
+    }
+#endif
+    size_t rank = 0;
+    for (size_t i = 0; i < count; i++)
+      rank += !comp(key, keys[i]);
+    return rank;
+  }
+
+#ifdef __AVX2__
+  static constexpr bool simdKeys =
+      std::is_same<Key, int>::value && (std::is_same<Compare, std::less<int>>::value || std::is_same<Compare, std::less<>>::value);
+
+  // Mask of the lanes of a block of 8 that hold one of the remaining keys. The
+  // key arrays are whole blocks, so a block never reads past them.
+  static unsigned lanes(size_t remaining)
+  {
+    return remaining >= 8 ? 0xff : (1u << remaining) - 1;
+  }
+#endif
+
+  const Leaf *findLeaf(const Key &key) const
+  {
+    const Node *node = root;
+    while (!node->leaf)
+    {
+      const Inner *inner = static_cast<const Inner *>(node);
+      node = inner->children[rankLessEqual(inner->keys, inner->count, key)];
+    }
+    return static_cast<const Leaf *>(node);
+  }
+
+  // Inserts into the subtree of node. If node splits, returns the new right
+  // sibling and sets separator to the smallest key of its subtree.
+  Node *insert(Node *node, const Key &key, const Value &value, Key &separator, bool &added)
+  {
+    if (node->leaf)
+      return insertIntoLeaf(static_cast<Leaf *>(node), key, value, separator, added);
+
+    Inner *inner = static_cast<Inner *>(node);
+    size_t i = rankLessEqual(inner->keys, inner->count, key);
+    Key childSeparator;
+    Node *right = insert(inner->children[i], key, value, childSeparator, added);
+    if (right == nullptr)
+      return nullptr;
+
+    if (inner->count < INNER_CAPACITY)
+    {
+      insertChild(inner, i, childSeparator, right);
+      return nullptr;
+    }
+
+    // Split: the middle key moves up, the upper half goes to a new node
+    Inner *sibling = new Inner();
+    size_t mid = INNER_CAPACITY / 2;
+    separator = inner->keys[mid];
+    sibling->count = INNER_CAPACITY - mid - 1;
+    std::copy(inner->keys + mid + 1, inner->keys + INNER_CAPACITY, sibling->keys);
+    std::copy(inner->children + mid + 1, inner->children + INNER_CAPACITY + 1, sibling->children);
+    inner->count = mid;
+    if (i <= mid)
+      insertChild(inner, i, childSeparator, right);
+    else
+      insertChild(sibling, i - mid - 1, childSeparator, right);
+    return sibling;
+  }
+
+  // Puts separator at keys[i] and right at children[i + 1] of a node with room
+  static void insertChild(Inner *inner, size_t i, const Key &separator, Node *right)
+  {
+    std::copy_backward(inner->keys + i, inner->keys + inner->count, inner->keys + inner->count + 1);
+    std::copy_backward(inner->children + i + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+    inner->keys[i] = separator;
+    inner->children[i + 1] = right;
+    inner->count++;
+  }
+
+  Node *insertIntoLeaf(Leaf *leaf, const Key &key, const Value &value, Key &separator, bool &added)
+  {
+    size_t i = rankLess(leaf->keys, leaf->count, key);
+    if (i < leaf->count && !comp(key, leaf->keys[i]))
+    {
+      leaf->values[i] = value;
+      return nullptr;
+    }
+    added = true;
+    if (leaf->count < LEAF_CAPACITY)
+    {
+      insertAt(leaf, i, key, value);
+      return nullptr;
+    }
+
+    // Split: the upper half moves to a new leaf linked after this one
+    Leaf *sibling = new Leaf();
+    size_t mid = (LEAF_CAPACITY + 1) / 2;
+    sibling->count = LEAF_CAPACITY - mid;
+    std::copy(leaf->keys + mid, leaf->keys + LEAF_CAPACITY, sibling->keys);
+    std::copy(leaf->values + mid, leaf->values + LEAF_CAPACITY, sibling->values);
+    leaf->count = mid;
+    sibling->next = leaf->next;
+    sibling->prev = leaf;
+    if (leaf->next != nullptr)
+      leaf->next->prev = sibling;
+    leaf->next = sibling;
+
+    if (i <= mid)
+      insertAt(leaf, i, key, value);
+    else
+      insertAt(sibling, i - mid, key, value);
+    separator = sibling->keys[0];
+    return sibling;
+  }
+
+  static void insertAt(Leaf *leaf, size_t i, const Key &key, const Value &value)
+  {
+    std::copy_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+    std::copy_backward(leaf->values + i, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+    leaf->keys[i] = key;
+    leaf->values[i] = value;
+    leaf->count++;
+  }
+
+  // Removes key from the subtree of node; a child left with too few keys
+  // borrows from a sibling or is merged with one
+  bool erase(Node *node, const Key &key)
+  {
+    if (node->leaf)
+    {
+      Leaf *leaf = static_cast<Leaf *>(node);
+      size_t i = rankLess(leaf->keys, leaf->count, key);
+      if (i == leaf->count || comp(key, leaf->keys[i]))
+        return false;
+      std::copy(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+      std::copy(leaf->values + i + 1, leaf->values + leaf->count, leaf->values + i);
+      leaf->count--;
+      return true;
+    }
+
+    Inner *inner = static_cast<Inner *>(node);
+    size_t i = rankLessEqual(inner->keys, inner->count, key);
+    if (!erase(inner->children[i], key))
+      return false;
+    Node *child = inner->children[i];
+    if (child->count < (child->leaf ? LEAF_MIN : INNER_MIN))
+      rebalance(inner, i);
+    return true;
+  }
+
+  // Refills children[i] of inner from its left or right sibling, or merges them
+  void rebalance(Inner *inner, size_t i)
+  {
+    size_t minimum = inner->children[i]->leaf ? LEAF_MIN : INNER_MIN;
+    if (i > 0 && inner->children[i - 1]->count > minimum)
+      borrowFromLeft(inner, i);
+    else if (i < inner->count && inner->children[i + 1]->count > minimum)
+      borrowFromRight(inner, i);
+    else if (i > 0)
+      mergeChildren(inner, i - 1);
+    else
+      mergeChildren(inner, i);
+  }
+
+  void borrowFromLeft(Inner *inner, size_t i)
+  {
+    if (inner->children[i]->leaf)
+    {
+      Leaf *child = static_cast<Leaf *>(inner->children[i]), *left = static_cast<Leaf *>(inner->children[i - 1]);
+      insertAt(child, 0, left->keys[left->count - 1], left->values[left->count - 1]);
+      left->count--;
+      inner->keys[i - 1] = child->keys[0];
+      return;
+    }
+    // Rotate through the parent's separator
+    Inner *child = static_cast<Inner *>(inner->children[i]), *left = static_cast<Inner *>(inner->children[i - 1]);
+    std::copy_backward(child->keys, child->keys + child->count, child->keys + child->count + 1);
+    std::copy_backward(child->children, child->children + child->count + 1, child->children + child->count + 2);
+    child->keys[0] = inner->keys[i - 1];
+    child->children[0] = left->children[left->count];
+    child->count++;
+    inner->keys[i - 1] = left->keys[left->count - 1];
+    left->count--;
+  }
+
+  void borrowFromRight(Inner *inner, size_t i)
+  {
+    if (inner->children[i]->leaf)
+    {
+      Leaf *child = static_cast<Leaf *>(inner->children[i]), *right = static_cast<Leaf *>(inner->children[i + 1]);
+      child->keys[child->count] = right->keys[0];
+      child->values[child->count] = right->values[0];
+      child->count++;
+      std::copy(right->keys + 1, right->keys + right->count, right->keys);
+      std::copy(right->values + 1, right->values + right->count, right->values);
+      right->count--;
+      inner->keys[i] = right->keys[0];
+      return;
+    }
+    Inner *child = static_cast<Inner *>(inner->children[i]), *right = static_cast<Inner *>(inner->children[i + 1]);
+    child->keys[child->count] = inner->keys[i];
+    child->children[child->count + 1] = right->children[0];
+    child->count++;
+    inner->keys[i] = right->keys[0];
+    std::copy(right->keys + 1, right->keys + right->count, right->keys);
+    std::copy(right->children + 1, right->children + right->count + 1, right->children);
+    right->count--;
+  }
+
+  // Merges children[i + 1] into children[i] and drops separator keys[i]
+  void mergeChildren(Inner *inner, size_t i)
+  {
+    if (inner->children[i]->leaf)
+    {
+      Leaf *left = static_cast<Leaf *>(inner->children[i]), *right = static_cast<Leaf *>(inner->children[i + 1]);
+      std::copy(right->keys, right->keys + right->count, left->keys + left->count);
+      std::copy(right->values, right->values + right->count, left->values + left->count);
+      left->count += right->count;
+      left->next = right->next;
+      if (right->next != nullptr)
+        right->next->prev = left;
+      delete right;
+    }
+    else
+    {
+      Inner *left = static_cast<Inner *>(inner->children[i]), *right = static_cast<Inner *>(inner->children[i + 1]);
+      left->keys[left->count] = inner->keys[i];
+      std::copy(right->keys, right->keys + right->count, left->keys + left->count + 1);
+      std::copy(right->children, right->children + right->count + 1, left->children + left->count + 1);
+      left->count += right->count + 1;
+      delete right;
+    }
+    std::copy(inner->keys + i + 1, inner->keys + inner->count, inner->keys + i);
+    std::copy(inner->children + i + 2, inner->children + inner->count + 1, inner->children + i + 1);
+    inner->count--;
+  }
+
+  void destroy(Node *node)
+  {
+    if (node->leaf)
+    {
+      delete static_cast<Leaf *>(node);
+      return;
+    }
+    Inner *inner = static_cast<Inner *>(node);
+    for (size_t i = 0; i <= inner->count; i++)
+      destroy(inner->children[i]);
+    delete inner;
+  }
+};
+
+#endif
@@ -0,0 +1,810 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+// B-tree of minimum degree t: every node but the root holds between t - 1 and
+// 2t - 1 keys. Duplicate keys are allowed.
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iterator>
+#include <queue>
+#include <stdexcept>
+#include <thread>
+
+template <typename T, int t>
+class BTree
+{
+  struct Node
+  {
+    bool leaf;
+    std::vector<T> keys;
+    std::vector<Node *> children;
+    Node *parent;
+
+    Node(bool isLeaf) : leaf(isLeaf), parent(nullptr) {}
+
+    bool isFull() const
+    {
+      return keys.size() == 2 * t - 1;
+    }
+
+    bool isUnderflow() const
+    {
+      return keys.size() < t - 1;
+    }
+
+    void insertKey(const T &key)
+    {
+      keys.insert(std::upper_bound(keys.begin(), keys.end(), key), key);
+    }
+
+    void removeKey(const T &key)
+    {
+      auto it = std::find(keys.begin(), keys.end(), key);
+      if (it != keys.end())
+      {
+        keys.erase(it);
+      }
+    }
+  };
+
+  Node *root;
+
+  void splitChild(Node *parent, int i)
+  {
+    Node *fullChild = parent->children[i];
+    Node *newChild = new Node(fullChild->leaf);
+    newChild->parent = parent;
+    newChild->keys.assign(fullChild->keys.begin() + t, fullChild->keys.end());
+    fullChild->keys.resize(t - 1);
+
+    if (!fullChild->leaf)
+    {
+      newChild->children.assign(fullChild->children.begin() + t, fullChild->children.end());
+      fullChild->children.resize(t);
+      for (Node *child : newChild->children)
+      {
+        child->parent = newChild;
+      }
+    }
+
+    parent->children.insert(parent->children.begin() + i + 1, newChild);
+    parent->keys.insert(parent->keys.begin() + i, fullChild->keys[t - 1]);
+  }
+
+  void insertNonFull(Node *node, const T &key)
+  {
+    if (node->leaf)
+    {
+      node->insertKey(key);
+    }
+    else
+    {
+      int i = node->keys.size() - 1;
+      while (i >= 0 && key < node->keys[i])
+      {
+        i--;
+      }
+      i++;
+      if (node->children[i]->isFull())
+      {
+        splitChild(node, i);
+        if (key > node->keys[i])
+        {
+          i++;
+        }
+      }
+      insertNonFull(node->children[i], key);
+    }
+  }
+
+  Node *findMin(Node *node)
+  {
+    while (!node->leaf)
+    {
+      node = node->children.front();
+    }
+    return node;
+  }
+
+  void merge(Node *parent, int idx)
+  {
+    Node *child = parent->children[idx];
+    Node *sibling = parent->children[idx + 1];
+
+    child->keys.push_back(parent->keys[idx]);
+    child->keys.insert(child->keys.end(), sibling->keys.begin(), sibling->keys.end());
+
+    if (!child->leaf)
+    {
+      for (Node *grandchild : sibling->children)
+      {
+        grandchild->parent = child;
+      }
+      child->children.insert(child->children.end(), sibling->children.begin(), sibling->children.end());
+    }
+
+    parent->keys.erase(parent->keys.begin() + idx);
+    parent->children.erase(parent->children.begin() + idx + 1);
+
+    delete sibling;
+  }
+
+  void fill(Node *node, int idx)
+  {
+    if (idx != 0 && node->children[idx - 1]->keys.size() >= t)
+    {
+      borrowFromPrev(node, idx);
+    }
+    else if (idx != node->keys.size() && node->children[idx + 1]->keys.size() >= t)
+    {
+      borrowFromNext(node, idx);
+    }
+    else
+    {
+      if (idx != node->keys.size())
+      {
+        merge(node, idx);
+      }
+      else
+      {
+        merge(node, idx - 1);
+      }
+    }
+  }
+
+  void borrowFromPrev(Node *node, int idx)
+  {
+    Node *child = node->children[idx];
+    Node *sibling = node->children[idx - 1];
+
+    child->keys.insert(child->keys.begin(), node->keys[idx - 1]);
+    if (!child->leaf)
+    {
+      child->children.insert(child->children.begin(), sibling->children.back());
+      child->children.front()->parent = child;
+      sibling->children.pop_back();
+    }
+    node->keys[idx - 1] = sibling->keys.back();
+    sibling->keys.pop_back();
+  }
+
+  void borrowFromNext(Node *node, int idx)
+  {
+    Node *child = node->children[idx];
+    Node *sibling = node->children[idx + 1];
+
+    child->keys.push_back(node->keys[idx]);
+    if (!child->leaf)
+    {
+      child->children.push_back(sibling->children.front());
+      child->children.back()->parent = child;
+      sibling->children.erase(sibling->children.begin());
+    }
+    node->keys[idx] = sibling->keys.front();
+    sibling->keys.erase(sibling->keys.begin());
+  }
+
+  void removeFromLeaf(Node *node, int idx)
+  {
+    node->keys.erase(node->keys.begin() + idx);
+  }
+
+  void removeFromNonLeaf(Node *node, int idx)
+  {
+    T key = node->keys[idx];
+
+    if (node->children[idx]->keys.size() >= t)
+    {
+      Node *predNode = node->children[idx];
+      while (!predNode->leaf)
+      {
+        predNode = predNode->children.back();
+      }
+      T pred = predNode->keys.back();
+      node->keys[idx] = pred;
+      remove(node->children[idx], pred);
+    }
+    else if (node->children[idx + 1]->keys.size() >= t)
+    {
+      Node *succNode = node->children[idx + 1];
+      while (!succNode->leaf)
+      {
+        succNode = succNode->children.front();
+      }
+      T succ = succNode->keys.front();
+      node->keys[idx] = succ;
+      remove(node->children[idx + 1], succ);
+    }
+    else
+    {
+      merge(node, idx);
+      remove(node->children[idx], key);
+    }
+  }
+
+  void remove(Node *node, const T &key)
+  {
+    int idx = std::lower_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+
+    if (idx < node->keys.size() && node->keys[idx] == key)
+    {
+      if (node->leaf)
+      {
+        removeFromLeaf(node, idx);
+      }
+      else
+      {
+        removeFromNonLeaf(node, idx);
+      }
+    }
+    else
+    {
+      if (node->leaf)
+      {
+        return;
+      }
+
+      bool flag = (idx == node->keys.size());
+
+      if (node->children[idx]->keys.size() < t)
+      {
+        fill(node, idx);
+      }
+
+      if (flag && idx > node->keys.size())
+      {
+        remove(node->children[idx - 1], key);
+      }
+      else
+      {
+        remove(node->children[idx], key);
+      }
+    }
+  }
+
+  void inOrderTraversal(Node *node) const
+  {
+    if (node == nullptr)
+      return;
+    for (size_t i = 0; i < node->keys.size(); ++i)
+    {
+      if (!node->leaf)
+      {
+        inOrderTraversal(node->children[i]);
+      }
+      std::cout << node->keys[i] << " ";
+    }
+    if (!node->leaf)
+    {
+      inOrderTraversal(node->children[node->keys.size()]);
+    }
+  }
+
+  void preOrderTraversal(Node *node) const
+  {
+    if (node == nullptr)
+      return;
+    for (const auto &key : node->keys)
+    {
+      std::cout << key << " ";
+    }
+    for (auto *child : node->children)
+    {
+      preOrderTraversal(child);
+    }
+  }
+
+  void postOrderTraversal(Node *node) const
+  {
+    if (node == nullptr)
+      return;
+    for (auto *child : node->children)
+    {
+      postOrderTraversal(child);
+    }
+    for (const auto &key : node->keys)
+    {
+      std::cout << key << " ";
+    }
+  }
+
+
+public:
+  BTree() : root(new Node(true)) {}
+
+  BTree(const BTree &) = delete;
+  BTree &operator=(const BTree &) = delete;
+
+  ~BTree()
+  {
+    destroy(root);
+  }
+
+  void insert(const T &key)
+  {
+    if (root == nullptr)
+    {
+      root = new Node(true);
+    }
+    if (root->isFull())
+    {
+      Node *newRoot = new Node(false);
+      newRoot->children.push_back(root);
+      root->parent = newRoot;
+      splitChild(newRoot, 0);
+      root = newRoot;
+    }
+    insertNonFull(root, key);
+  }
+
+  void remove(const T &key)
+  {
+    if (root == nullptr)
+    {
+      return;
+    }
+    remove(root, key);
+
+    if (root->keys.empty())
+    {
+      Node *temp = root;
+      if (!root->leaf)
+      {
+        root = root->children[0];
+        root->parent = nullptr;
+      }
+      else
+      {
+        root = nullptr;
+      }
+      delete temp;
+    }
+  }
+
+  bool search(Node *node, const T &key) const
+  {
+    if (node == nullptr)
+      return false;
+    auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+    if (it != node->keys.end() && *it == key)
+    {
+      return true;
+    }
+    if (node->leaf)
+    {
+      return false;
+    }
+    return search(node->children[it - node->keys.begin()], key);
+  }
+
+  bool search(const T &key) const
+  {
+    return search(root, key);
+  }
+
+  // Bidirectional iterator over the keys in order. It moves along the parent
+  // pointers, so it needs neither recursion nor a stack.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    const_iterator() = default;
+
+    reference operator*() const
+    {
+      return node->keys[index];
+    }
+
+    pointer operator->() const
+    {
+      return &node->keys[index];
+    }
+
+    const_iterator &operator++()
+    {
+      if (!node->leaf)
+      {
+        // The successor is the first key of the leftmost leaf of the right subtree
+        node = node->children[index + 1];
+        while (!node->leaf)
+          node = node->children.front();
+        index = 0;
+      }
+      else
+      {
+        index++;
+      }
+      climbToNext();
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    const_iterator &operator--()
+    {
+      if (node == nullptr || !node->leaf)
+      {
+        // The predecessor is the last key of the rightmost leaf of the left
+        // subtree; from the end, of the whole tree
+        node = node == nullptr ? tree->root : node->children[index];
+        while (!node->leaf)
+          node = node->children.back();
+        index = node->keys.size();
+      }
+      if (index > 0)
+      {
+        index--;
+        return *this;
+      }
+      // Up to the first ancestor that has a key before this subtree
+      while (node->parent != nullptr)
+      {
+        size_t child = childIndex();
+        node = node->parent;
+        if (child > 0)
+        {
+          index = child - 1;
+          return *this;
+        }
+      }
+      node = nullptr;
+      return *this;
+    }
+
+    const_iterator operator--(int)
+    {
+      const_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator &other) const
+    {
+      return node == other.node && index == other.index;
+    }
+
+    bool operator!=(const const_iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class BTree;
+    const BTree *tree = nullptr;
+    const Node *node = nullptr; // nullptr at the end
+    size_t index = 0;
+
+    const_iterator(const BTree *tree, const Node *node, size_t index) : tree(tree), node(node), index(index) {}
+
+    size_t childIndex() const
+    {
+      const auto &siblings = node->parent->children;
+      return std::find(siblings.begin(), siblings.end(), node) - siblings.begin();
+    }
+
+    // Past the last key of a leaf: up to the first ancestor with a key after this subtree
+    void climbToNext()
+    {
+      while (index >= node->keys.size())
+      {
+        if (node->parent == nullptr)
+        {
+          node = nullptr;
+          index = 0;
+          return;
+        }
+        index = childIndex();
+        node = node->parent;
+      }
+    }
+  };
+
+  using iterator = const_iterator;
+
+  // The keys in [lo, hi), produced lazily as the range is iterated
+  struct Range
+  {
+    const_iterator first, last;
+
+    const_iterator begin() const
+    {
+      return first;
+    }
+
+    const_iterator end() const
+    {
+      return last;
+    }
+  };
+
+  const_iterator begin() const
+  {
+    if (root == nullptr)
+      return end();
+    const Node *node = root;
+    while (!node->leaf)
+      node = node->children.front();
+    const_iterator it(this, node, 0);
+    it.climbToNext();
+    return it;
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(this, nullptr, 0);
+  }
+
+  // First key not less than key
+  const_iterator lower_bound(const T &key) const
+  {
+    return bound(key, false);
+  }
+
+  // First key greater than key
+  const_iterator upper_bound(const T &key) const
+  {
+    return bound(key, true);
+  }
+
+  Range range(const T &lo, const T &hi) const
+  {
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
+  // Replaces the content with sorted keys, built bottom-up instead of by one
+  // insert per key: the keys are cut into leaves of about fillFactor * (2t - 1) keys
+  // with one key left between neighbouring leaves, and those keys are cut the
+  // same way into the next level, until one node is left. Each level is one
+  // pass, split between threads.
+  void bulkLoad(const std::vector<T> &sorted, double fillFactor = 1.0, int threads = 1)
+  {
+    bulkLoad(KeySpans{{sorted.data()}, {0, sorted.size()}}, fillFactor, threads);
+  }
+
+  // The same from sorted partitions that follow one another in order, such as
+  // the output of a parallel sort, without concatenating them first
+  void bulkLoad(const std::vector<std::vector<T>> &partitions, double fillFactor = 1.0, int threads = 1)
+  {
+    KeySpans spans;
+    spans.offsets.push_back(0);
+    for (const auto &partition : partitions)
+    {
+      spans.data.push_back(partition.data());
+      spans.offsets.push_back(spans.offsets.back() + partition.size());
+    }
+    bulkLoad(spans, fillFactor, threads);
+  }
+
+  void inOrderTraversal() const
+  {
+    inOrderTraversal(root);
+    std::cout << std::endl;
+  }
+
+  void preOrderTraversal() const
+  {
+    preOrderTraversal(root);
+    std::cout << std::endl;
+  }
+
+  void postOrderTraversal() const
+  {
+    postOrderTraversal(root);
+    std::cout << std::endl;
+  }
+
+  void levelOrderTraversal() const
+  {
+    if (root == nullptr)
+      return;
+    std::queue<Node *> q;
+    q.push(root);
+    while (!q.empty())
+    {
+      Node *node = q.front();
+      q.pop();
+      for (const auto &key : node->keys)
+      {
+        std::cout << key << " ";
+      }
+      for (auto *child : node->children)
+      {
+        q.push(child);
+      }
+    }
+    std::cout << std::endl;
+  }
+
+private:
+  // Sorted keys in consecutive arrays: array i holds the keys [offsets[i], offsets[i + 1])
+  struct KeySpans
+  {
+    std::vector<const T *> data;
+    std::vector<size_t> offsets;
+
+    size_t size() const
+    {
+      return offsets.back();
+    }
+  };
+
+  // Reads the keys of KeySpans in order from a given index
+  struct KeyCursor
+  {
+    const KeySpans &spans;
+    size_t span, position;
+
+    KeyCursor(const KeySpans &spans, size_t index) : spans(spans)
+    {
+      span = std::upper_bound(spans.offsets.begin(), spans.offsets.end(), index) - spans.offsets.begin() - 1;
+      position = index - spans.offsets[span];
+    }
+
+    const T &next()
+    {
+      while (spans.offsets[span] + position == spans.offsets[span + 1])
+      {
+        span++;
+        position = 0;
+      }
+      return spans.data[span][position++];
+    }
+  };
+
+  void bulkLoad(const KeySpans &keys, double fillFactor, int threads)
+  {
+    size_t capacity = std::lround(fillFactor * (2 * t - 1));
+    capacity = std::min<size_t>(std::max<size_t>(capacity, t - 1), 2 * t - 1);
+    threads = std::max(threads, 1);
+
+    std::vector<Node *> nodes, children;
+    std::vector<T> separators;
+    buildLevel(keys, children, capacity, threads, nodes, separators);
+    while (nodes.size() > 1)
+    {
+      children.swap(nodes);
+      KeySpans upper{{separators.data()}, {0, separators.size()}};
+      std::vector<T> upperSeparators;
+      buildLevel(upper, children, capacity, threads, nodes, upperSeparators);
+      separators.swap(upperSeparators);
+    }
+
+    destroy(root);
+    root = nodes.front();
+  }
+
+  // Builds one level from keys and, above the leaves, the nodes of the level
+  // below (one more than the keys). Every node takes a share of the keys and
+  // the children between them; the key after each node but the last goes to
+  // separators. The number of nodes keeps each between t - 1 and 2t - 1 keys.
+  void buildLevel(const KeySpans &keys, const std::vector<Node *> &children, size_t capacity, int threads,
+                  std::vector<Node *> &nodes, std::vector<T> &separators)
+  {
+    size_t m = keys.size();
+    size_t count = std::lround(double(m + 1) / (capacity + 1));
+    count = std::min<size_t>(std::max<size_t>(count, (m + 2 * t) / (2 * t)), std::max<size_t>((m + 1) / t, 1));
+    size_t nodeKeys = m - (count - 1), base = nodeKeys / count, extra = nodeKeys % count;
+
+    nodes.assign(count, nullptr);
+    separators.resize(count - 1);
+    bool leaves = children.empty();
+    std::vector<std::exception_ptr> errors(threads);
+    auto build = [&](int thread) {
+      try
+      {
+        size_t first = count * thread / threads, last = count * (thread + 1) / threads;
+        if (first == last)
+          return;
+        size_t start = first * (base + 1) + std::min(first, extra);
+        KeyCursor cursor(keys, start > 0 ? start - 1 : 0);
+        const T *previous = start > 0 ? &cursor.next() : nullptr;
+        for (size_t j = first; j < last; j++, start++)
+        {
+          Node *node = new Node(leaves);
+          nodes[j] = node;
+          size_t size = base + (j < extra);
+          node->keys.reserve(size);
+          for (size_t i = 0; i < size; i++)
+          {
+            const T &key = cursor.next();
+            if (previous != nullptr && key < *previous)
+            {
+              throw std::invalid_argument("bulkLoad needs keys in sorted order");
+            }
+            node->keys.push_back(key);
+            previous = &node->keys.back();
+          }
+          if (!leaves)
+          {
+            node->children.assign(children.begin() + start, children.begin() + start + size + 1);
+            for (Node *child : node->children)
+            {
+              child->parent = node;
+            }
+          }
+          start += size;
+          if (j + 1 < count)
+          {
+            const T &separator = cursor.next();
+            if (separator < *previous)
+            {
+              throw std::invalid_argument("bulkLoad needs keys in sorted order");
+            }
+            separators[j] = separator;
+            previous = &separators[j];
+          }
+        }
+      }
+      catch (...)
+      {
+        errors[thread] = std::current_exception();
+      }
+    };
+
+    std::vector<std::thread> workers;
+    for (int thread = 1; thread < threads; thread++)
+    {
+      workers.emplace_back(build, thread);
+    }
+    build(0);
+    for (auto &worker : workers)
+    {
+      worker.join();
+    }
+    for (auto &error : errors)
+    {
+      if (error)
+      {
+        for (Node *node : nodes)
+        {
+          delete node; // only the leaves can find keys out of order, so these have no children
+        }
+        std::rethrow_exception(error);
+      }
+    }
+  }
+
+  void destroy(Node *node)
+  {
+    if (node == nullptr)
+      return;
+    for (Node *child : node->children)
+    {
+      destroy(child);
+    }
+    delete node;
+  }
+
+  // The last node on the way down from the root with a bounding key: the
+  // subtree left of that key holds no key within the bound
+  const_iterator bound(const T &key, bool upper) const
+  {
+    const_iterator result = end();
+    for (const Node *node = root; node != nullptr;)
+    {
+      auto it = upper ? std::upper_bound(node->keys.begin(), node->keys.end(), key)
+                      : std::lower_bound(node->keys.begin(), node->keys.end(), key);
+      size_t i = it - node->keys.begin();
+      if (i < node->keys.size())
+        result = const_iterator(this, node, i);
+      node = node->leaf ? nullptr : node->children[i];
+    }
+    return result;
+  }
+};
+
+#endif
@@ -0,0 +1,223 @@
+// Scaling of the concurrent B-tree in concurrentbtree.h against BTree from btree.h and
+// std::set, each behind one mutex, from 1 to N threads with several shares of lookups
+// among inserts and removes
+// Build: g++ -std=c++17 -O2 -pthread concurrentbtree.cpp
+// Usage: concurrentbtree [largest number of threads, default all cores] [operations per thread, default 1e6]
+//                        [key range, default 1e6]
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "btree.h"
+#include "concurrentbtree.h"
+
+// BTree with one global mutex, the way a single-threaded tree is usually shared.
+// BTree keeps duplicates, so insert and remove look the key up first to act like a set.
+class LockedBTree
+{
+public:
+  bool contains(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return tree.search(key);
+  }
+
+  bool insert(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tree.search(key))
+      return false;
+    tree.insert(key);
+    return true;
+  }
+
+  bool remove(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!tree.search(key))
+      return false;
+    tree.remove(key);
+    return true;
+  }
+
+private:
+  std::mutex mutex;
+  BTree<int, 16> tree;
+};
+
+// std::set with one global mutex
+class LockedSet
+{
+public:
+  bool contains(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set.count(key) != 0;
+  }
+
+  bool insert(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set.insert(key).second;
+  }
+
+  bool remove(int key)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set.erase(key) != 0;
+  }
+
+private:
+  std::mutex mutex;
+  std::set<int> set;
+};
+
+// xorshift64: a generator per thread, so threads share nothing but the tree
+uint64_t nextRandom(uint64_t &state)
+{
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+// Runs threads doing operations each, lookups with probability readShare and
+// otherwise inserts and removes in equal parts; returns millions of operations per second
+template <typename Tree>
+double run(Tree &tree, int threads, size_t operations, int range, double readShare)
+{
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<size_t> found{0};
+  const uint64_t readBelow = static_cast<uint64_t>(readShare * 1000);
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < threads; thread++)
+  {
+    workers.emplace_back([&, thread] {
+      uint64_t state = 0x9e3779b97f4a7c15ULL * (thread + 1);
+      size_t hits = 0;
+      ready++;
+      while (!go)
+        std::this_thread::yield();
+      for (size_t i = 0; i < operations; i++)
+      {
+        uint64_t random = nextRandom(state);
+        int key = static_cast<int>((random >> 16) % range);
+        uint64_t kind = random % 1000;
+        if (kind < readBelow)
+          hits += tree.contains(key);
+        else if (kind % 2 == 0)
+          hits += tree.insert(key);
+        else
+          hits += tree.remove(key);
+      }
+      found += hits;
+    });
+  }
+  while (ready < threads)
+    std::this_thread::yield();
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto &worker : workers)
+    worker.join();
+  auto stop = std::chrono::steady_clock::now();
+  return threads * operations / std::chrono::duration<double, std::micro>(stop - start).count();
+}
+
+// Threads insert and remove keys of their own residue class and check each
+// answer, then the tree must hold exactly what every thread left in it
+bool check(int threads, int range, size_t &retired)
+{
+  ConcurrentBTree<int, 4> tree; // small nodes: many splits and merges
+  std::vector<std::vector<bool>> present(threads, std::vector<bool>(range));
+  std::atomic<bool> same{true};
+  std::vector<std::thread> workers;
+  for (int thread = 0; thread < threads; thread++)
+  {
+    workers.emplace_back([&, thread] {
+      uint64_t state = 12345 + thread;
+      for (int i = 0; i < 200000; i++)
+      {
+        uint64_t random = nextRandom(state);
+        int slot = static_cast<int>((random >> 8) % (range / threads));
+        int key = slot * threads + thread;
+        bool answer;
+        if (random % 3 == 0)
+        {
+          answer = tree.contains(key) == present[thread][slot];
+        }
+        else if (random % 3 == 1)
+        {
+          answer = tree.insert(key) == !present[thread][slot];
+          present[thread][slot] = true;
+        }
+        else
+        {
+          answer = tree.remove(key) == present[thread][slot];
+          present[thread][slot] = false;
+        }
+        if (!answer)
+          same = false;
+      }
+    });
+  }
+  for (auto &worker : workers)
+    worker.join();
+
+  std::vector<int> expected;
+  for (int key = 0; key < range / threads * threads; key++)
+  {
+    if (present[key % threads][key / threads])
+      expected.push_back(key);
+  }
+  retired = tree.retiredNodes();
+  return same && tree.keys() == expected;
+}
+
+int main(int argc, char *argv[])
+{
+  int maxThreads = argc > 1 ? std::stoi(argv[1]) : std::max(1u, std::thread::hardware_concurrency());
+  size_t operations = argc > 2 ? static_cast<size_t>(std::stod(argv[2])) : 1000000;
+  int range = argc > 3 ? static_cast<int>(std::stod(argv[3])) : 1000000;
+
+  std::vector<int> threadCounts;
+  for (int threads = 1; threads < maxThreads; threads *= 2)
+    threadCounts.push_back(threads);
+  threadCounts.push_back(maxThreads);
+
+  std::cout << "Mops/s, " << operations << " operations per thread on keys in [0, " << range << ")" << std::endl;
+  for (double readShare : {1.0, 0.95, 0.5, 0.0})
+  {
+    std::cout << readShare * 100 << "% lookups" << std::endl;
+    for (int threads : threadCounts)
+    {
+      // Start half full, so inserts and removes both find work
+      ConcurrentBTree<int> tree;
+      LockedBTree lockedTree;
+      LockedSet lockedSet;
+      for (int key = 0; key < range; key += 2)
+      {
+        tree.insert(key);
+        lockedTree.insert(key);
+        lockedSet.insert(key);
+      }
+      double olc = run(tree, threads, operations, range, readShare);
+      double btree = run(lockedTree, threads, operations, range, readShare);
+      double set = run(lockedSet, threads, operations, range, readShare);
+      std::cout << "  " << threads << " threads: optimistic lock coupling " << olc << ", BTree with a mutex " << btree
+                << ", std::set with a mutex " << set << std::endl;
+    }
+  }
+
+  size_t retired;
+  bool same = check(std::max(maxThreads, 4), 1 << 14, retired);
+  std::cout << (same ? "Concurrent B-tree agrees with each thread" : "Wrong answers") << ", " << retired
+            << " removed nodes not yet freed" << std::endl;
+  return same ? 0 : 1;
+}
@@ -0,0 +1,669 @@
+#ifndef CONCURRENTBTREE_H
+#define CONCURRENTBTREE_H
+
+// B-tree set for many threads with optimistic lock coupling (Leis et al.,
+// "The ART of Practical Synchronization"). Every node has a version counter
+// with a lock bit and an obsolete bit:
+// - readers take no locks: they note the version of a node, read it, and
+//   check that the version did not change before they trust what they read;
+//   if it did, they start again from the root
+// - a writer changes a node only after swapping the version it read for a
+//   locked one, so an insert or remove locks just its leaf, and a split or
+//   merge locks the parent, the node and for a merge one sibling
+// - as in BTree, full nodes are split and thin nodes merged or refilled from
+//   a sibling on the way down, so a change never climbs back up
+// Unlike BTree, keys live only in the leaves and inner nodes hold separators,
+// so a remove never has to lock a path to find a replacement key.
+// Readers may look at a node while it is being written, so the count, keys
+// and children are atomics read and written relaxed: a torn view is no data
+// race, and the version check alone decides whether it is used. Nodes removed
+// by merges can still be in use by readers, so they are freed with epochs:
+// each thread announces the global epoch while it works on the tree, and a
+// removed node is freed once no thread announces an epoch from before it left.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+template <typename T, int t = 16>
+class ConcurrentBTree
+{
+  static_assert(t >= 2, "the minimum degree must be at least 2");
+  static_assert(std::is_trivially_copyable<T>::value, "keys are std::atomic<T>");
+
+public:
+  static constexpr int MAX_KEYS = 2 * t - 1;
+  static constexpr int MIN_KEYS = MAX_KEYS / 4; // nodes with no more keys are refilled on the way down
+  static constexpr size_t RECLAIM_BATCH = 64;    // removed nodes gathered before trying to free them
+
+  ConcurrentBTree() : root(new Node(true)), id(nextId()) {}
+
+  ConcurrentBTree(const ConcurrentBTree &) = delete;
+  ConcurrentBTree &operator=(const ConcurrentBTree &) = delete;
+
+  ~ConcurrentBTree()
+  {
+    destroy(root.load());
+    for (const Retired &entry : retired)
+      free(entry.node);
+  }
+
+  bool contains(const T &key) const
+  {
+    EpochGuard guard(*this);
+    bool found;
+    while (!tryContains(key, found))
+    {
+    }
+    return found;
+  }
+
+  // Adds key; returns false if it is already in the tree
+  bool insert(const T &key)
+  {
+    EpochGuard guard(*this);
+    bool inserted;
+    while (!tryInsert(key, inserted))
+    {
+    }
+    return inserted;
+  }
+
+  // Removes key; returns false if it is not in the tree
+  bool remove(const T &key)
+  {
+    EpochGuard guard(*this);
+    bool removed;
+    while (!tryRemove(key, removed))
+    {
+    }
+    return removed;
+  }
+
+  // Keys in order; only while no thread changes the tree
+  std::vector<T> keys() const
+  {
+    std::vector<T> out;
+    collect(root.load(), out);
+    return out;
+  }
+
+  int height() const
+  {
+    int levels = 1;
+    for (const Node *node = root.load(); !node->leaf; node = static_cast<const Inner *>(node)->child(0))
+      levels++;
+    return levels;
+  }
+
+  // Removed nodes that some thread may still see, so not yet freed
+  size_t retiredNodes() const
+  {
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    return retired.size();
+  }
+
+private:
+  static constexpr uint64_t OBSOLETE = 1, LOCKED = 2;
+
+  struct alignas(64) Node
+  {
+    std::atomic<uint64_t> version{0};
+    bool leaf;
+    std::atomic<int> count{0};
+    std::atomic<T> keys[MAX_KEYS] = {};
+
+    Node(bool leaf) : leaf(leaf) {}
+
+    int size() const
+    {
+      return count.load(std::memory_order_relaxed);
+    }
+
+    void setSize(int size)
+    {
+      count.store(size, std::memory_order_relaxed);
+    }
+
+    T key(int i) const
+    {
+      return keys[i].load(std::memory_order_relaxed);
+    }
+
+    void setKey(int i, const T &key)
+    {
+      keys[i].store(key, std::memory_order_relaxed);
+    }
+
+    // Waits while the node is locked; false if it was removed from the tree
+    bool readLock(uint64_t &seen) const
+    {
+      while ((seen = version.load(std::memory_order_acquire)) & LOCKED)
+        std::this_thread::yield();
+      return !(seen & OBSOLETE);
+    }
+
+    // True if nothing changed the node since its version was seen
+    bool validate(uint64_t seen) const
+    {
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return version.load(std::memory_order_relaxed) == seen;
+    }
+
+    // Locks the node if its version is still seen
+    bool upgrade(uint64_t seen)
+    {
+      return version.compare_exchange_strong(seen, seen + LOCKED, std::memory_order_acquire);
+    }
+
+    // Locks the node without waiting, for a writer that already holds locks
+    bool tryLock()
+    {
+      uint64_t seen = version.load(std::memory_order_relaxed);
+      return !(seen & (LOCKED | OBSOLETE)) && upgrade(seen);
+    }
+
+    // Clears the lock bit and counts a new version
+    void unlock()
+    {
+      version.fetch_add(LOCKED, std::memory_order_release);
+    }
+
+    void unlockObsolete()
+    {
+      version.fetch_add(LOCKED | OBSOLETE, std::memory_order_release);
+    }
+  };
+
+  // Child i holds the keys in [keys[i - 1], keys[i])
+  struct Inner : Node
+  {
+    std::atomic<Node *> children[MAX_KEYS + 1] = {};
+
+    Inner() : Node(false) {}
+
+    Node *child(int i) const
+    {
+      return children[i].load(std::memory_order_relaxed);
+    }
+
+    void setChild(int i, Node *child)
+    {
+      children[i].store(child, std::memory_order_relaxed);
+    }
+  };
+
+  // The epoch a thread announces while it works on the tree, 0 when it does not
+  struct alignas(64) Slot
+  {
+    std::atomic<uint64_t> epoch{0};
+  };
+
+  // Announces the current epoch for the lifetime of an operation
+  class EpochGuard
+  {
+  public:
+    explicit EpochGuard(const ConcurrentBTree &tree) : slot(tree.slot())
+    {
+      slot.epoch.store(tree.globalEpoch.load(), std::memory_order_relaxed);
+      // The announcement must be visible before any node is read
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    ~EpochGuard()
+    {
+      slot.epoch.store(0, std::memory_order_release);
+    }
+
+  private:
+    Slot &slot;
+  };
+
+  struct Retired
+  {
+    uint64_t epoch;
+    Node *node;
+  };
+
+  std::atomic<Node *> root;
+  const uint64_t id; // tells trees apart in the per-thread slot cache
+  std::atomic<uint64_t> globalEpoch{1};
+  mutable std::mutex slotMutex;
+  mutable std::map<std::thread::id, std::unique_ptr<Slot>> slots;
+  mutable std::mutex retiredMutex;
+  std::vector<Retired> retired;
+
+  static uint64_t nextId()
+  {
+    static std::atomic<uint64_t> trees{0};
+    return ++trees;
+  }
+
+  // The slot of the calling thread, remembered per thread for the last tree it used
+  Slot &slot() const
+  {
+    thread_local uint64_t cachedId = 0;
+    thread_local Slot *cachedSlot = nullptr;
+    if (cachedId != id)
+    {
+      std::lock_guard<std::mutex> lock(slotMutex);
+      std::unique_ptr<Slot> &entry = slots[std::this_thread::get_id()];
+      if (!entry)
+        entry.reset(new Slot());
+      cachedId = id;
+      cachedSlot = entry.get();
+    }
+    return *cachedSlot;
+  }
+
+  // The number of keys of a node that may be read mid-change, kept inside the array
+  static int clampedSize(const Node *node)
+  {
+    return std::min(std::max(node->size(), 0), MAX_KEYS);
+  }
+
+  // Index of the first key greater than key
+  static int childIndex(const Inner *inner, const T &key)
+  {
+    int low = 0, high = clampedSize(inner);
+    while (low < high)
+    {
+      int middle = (low + high) / 2;
+      if (key < inner->key(middle))
+        high = middle;
+      else
+        low = middle + 1;
+    }
+    return low;
+  }
+
+  // Index of the first key not less than key
+  static int keyIndex(const Node *leaf, const T &key)
+  {
+    int low = 0, high = clampedSize(leaf);
+    while (low < high)
+    {
+      int middle = (low + high) / 2;
+      if (leaf->key(middle) < key)
+        low = middle + 1;
+      else
+        high = middle;
+    }
+    return low;
+  }
+
+  // std::copy and std::copy_backward for arrays of atomics, plus copies out of
+  // and into plain arrays; writers hold the locks, so relaxed order is enough
+  template <typename A>
+  static void copyAtomics(const std::atomic<A> *first, const std::atomic<A> *last, std::atomic<A> *out)
+  {
+    for (; first != last; ++first, ++out)
+      out->store(first->load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  template <typename A>
+  static void copyAtomicsBackward(const std::atomic<A> *first, const std::atomic<A> *last, std::atomic<A> *outLast)
+  {
+    while (last != first)
+      (--outLast)->store((--last)->load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+
+  template <typename A>
+  static A *loadAtomics(const std::atomic<A> *first, const std::atomic<A> *last, A *out)
+  {
+    for (; first != last; ++first, ++out)
+      *out = first->load(std::memory_order_relaxed);
+    return out;
+  }
+
+  template <typename A>
+  static void storeAtomics(const A *first, const A *last, std::atomic<A> *out)
+  {
+    for (; first != last; ++first, ++out)
+      out->store(*first, std::memory_order_relaxed);
+  }
+
+  // The next three return false when the operation has to start again
+
+  bool tryContains(const T &key, bool &found) const
+  {
+    Node *node = root.load();
+    uint64_t version;
+    if (!node->readLock(version) || node != root.load())
+      return false;
+    while (!node->leaf)
+    {
+      const Inner *inner = static_cast<const Inner *>(node);
+      Node *child = inner->child(childIndex(inner, key));
+      if (!inner->validate(version))
+        return false;
+      // Check the parent again once the child's version is known: a split or
+      // merge in between may have moved the key out of the child
+      uint64_t parentVersion = version;
+      node = child;
+      if (!node->readLock(version) || !inner->validate(parentVersion))
+        return false;
+    }
+    int i = keyIndex(node, key);
+    found = i < clampedSize(node) && !(key < node->key(i));
+    return node->validate(version);
+  }
+
+  bool tryInsert(const T &key, bool &inserted)
+  {
+    Node *node = root.load();
+    uint64_t version;
+    if (!node->readLock(version) || node != root.load())
+      return false;
+    Inner *parent = nullptr;
+    uint64_t parentVersion = 0;
+
+    while (true)
+    {
+      if (node->size() == MAX_KEYS)
+      {
+        // Split the full node under locks on it and its parent, then start again
+        if (parent != nullptr && !parent->upgrade(parentVersion))
+          return false;
+        if (!node->upgrade(version))
+        {
+          if (parent != nullptr)
+            parent->unlock();
+          return false;
+        }
+        if (parent == nullptr && node != root.load())
+        {
+          node->unlock();
+          return false;
+        }
+        T separator;
+        Node *sibling = split(node, separator);
+        if (parent != nullptr)
+        {
+          int i = childIndex(parent, separator), count = parent->size();
+          copyAtomicsBackward(parent->keys + i, parent->keys + count, parent->keys + count + 1);
+          copyAtomicsBackward(parent->children + i + 1, parent->children + count + 1, parent->children + count + 2);
+          parent->setKey(i, separator);
+          parent->setChild(i + 1, sibling);
+          parent->setSize(count + 1);
+        }
+        else
+        {
+          Inner *newRoot = new Inner();
+          newRoot->setKey(0, separator);
+          newRoot->setChild(0, node);
+          newRoot->setChild(1, sibling);
+          newRoot->setSize(1);
+          root.store(newRoot);
+        }
+        node->unlock();
+        if (parent != nullptr)
+          parent->unlock();
+        return false;
+      }
+      if (node->leaf)
+        break;
+
+      Inner *inner = static_cast<Inner *>(node);
+      if (parent != nullptr && !parent->validate(parentVersion))
+        return false;
+      Node *child = inner->child(childIndex(inner, key));
+      if (!inner->validate(version))
+        return false;
+      parent = inner;
+      parentVersion = version;
+      node = child;
+      if (!node->readLock(version))
+        return false;
+    }
+
+    // A leaf with room: lock only the leaf
+    if (!node->upgrade(version))
+      return false;
+    if (parent != nullptr && !parent->validate(parentVersion))
+    {
+      node->unlock();
+      return false;
+    }
+    int i = keyIndex(node, key), count = node->size();
+    inserted = i == count || key < node->key(i);
+    if (inserted)
+    {
+      copyAtomicsBackward(node->keys + i, node->keys + count, node->keys + count + 1);
+      node->setKey(i, key);
+      node->setSize(count + 1);
+    }
+    node->unlock();
+    return true;
+  }
+
+  bool tryRemove(const T &key, bool &removed)
+  {
+    Node *node = root.load();
+    uint64_t version;
+    if (!node->readLock(version) || node != root.load())
+      return false;
+    Inner *parent = nullptr;
+    uint64_t parentVersion = 0;
+
+    while (!node->leaf)
+    {
+      Inner *inner = static_cast<Inner *>(node);
+      int i = childIndex(inner, key);
+      Node *child = inner->child(i);
+      if (!inner->validate(version))
+        return false;
+      uint64_t childVersion;
+      if (!child->readLock(childVersion) || !inner->validate(version))
+        return false;
+
+      if (child->size() <= MIN_KEYS && inner->size() > 0)
+      {
+        // Merge the thin child with a sibling or move keys over from it, under
+        // locks on the node, the child and the sibling, then start again
+        if (!inner->upgrade(version))
+          return false;
+        if (!child->upgrade(childVersion))
+        {
+          inner->unlock();
+          return false;
+        }
+        int left = i < inner->size() ? i : i - 1;
+        Node *sibling = inner->child(left == i ? i + 1 : i - 1);
+        if (!sibling->tryLock())
+        {
+          child->unlock();
+          inner->unlock();
+          return false;
+        }
+        Node *leftNode = left == i ? child : sibling, *rightNode = left == i ? sibling : child;
+        if (rebalance(inner, left, leftNode, rightNode))
+        {
+          rightNode->unlockObsolete();
+          retire(rightNode);
+        }
+        else
+        {
+          rightNode->unlock();
+        }
+        leftNode->unlock();
+        if (inner->size() == 0 && inner == root.load())
+        {
+          // Only the root can lose its last key: its one child takes its place
+          root.store(leftNode);
+          inner->unlockObsolete();
+          retire(inner);
+        }
+        else
+        {
+          inner->unlock();
+        }
+        return false;
+      }
+      parent = inner;
+      parentVersion = version;
+      node = child;
+      version = childVersion;
+    }
+
+    if (!node->upgrade(version))
+      return false;
+    if (parent != nullptr && !parent->validate(parentVersion))
+    {
+      node->unlock();
+      return false;
+    }
+    int i = keyIndex(node, key), count = node->size();
+    removed = i < count && !(key < node->key(i));
+    if (removed)
+    {
+      copyAtomics(node->keys + i + 1, node->keys + count, node->keys + i);
+      node->setSize(count - 1);
+    }
+    node->unlock();
+    return true;
+  }
+
+  // Moves the upper half of the locked, full node to a new sibling
+  static Node *split(Node *node, T &separator)
+  {
+    int half = MAX_KEYS / 2;
+    if (node->leaf)
+    {
+      Node *sibling = new Node(true);
+      sibling->setSize(MAX_KEYS - half);
+      copyAtomics(node->keys + half, node->keys + MAX_KEYS, sibling->keys);
+      node->setSize(half);
+      separator = sibling->key(0);
+      return sibling;
+    }
+    Inner *inner = static_cast<Inner *>(node), *sibling = new Inner();
+    sibling->setSize(MAX_KEYS - half - 1);
+    copyAtomics(inner->keys + half + 1, inner->keys + MAX_KEYS, sibling->keys);
+    copyAtomics(inner->children + half + 1, inner->children + MAX_KEYS + 1, sibling->children);
+    inner->setSize(half);
+    separator = inner->key(half);
+    return sibling;
+  }
+
+  // Merges the locked children left and left + 1 of the locked parent if they
+  // fit one node and returns true, or else shares their keys evenly
+  static bool rebalance(Inner *parent, int left, Node *leftNode, Node *rightNode)
+  {
+    // All keys of both, with the separator between them for inner nodes
+    T keys[2 * MAX_KEYS + 1];
+    Node *children[2 * MAX_KEYS + 2];
+    int leftCount = leftNode->size(), rightCount = rightNode->size();
+    int count = loadAtomics(leftNode->keys, leftNode->keys + leftCount, keys) - keys, childCount = 0;
+    if (!leftNode->leaf)
+    {
+      keys[count++] = parent->key(left);
+      Inner *leftInner = static_cast<Inner *>(leftNode), *rightInner = static_cast<Inner *>(rightNode);
+      childCount = loadAtomics(leftInner->children, leftInner->children + leftCount + 1, children) - children;
+      childCount = loadAtomics(rightInner->children, rightInner->children + rightCount + 1, children + childCount) -
+                   children;
+    }
+    count = loadAtomics(rightNode->keys, rightNode->keys + rightCount, keys + count) - keys;
+
+    if (count <= MAX_KEYS)
+    {
+      storeAtomics(keys, keys + count, leftNode->keys);
+      if (!leftNode->leaf)
+        storeAtomics(children, children + childCount, static_cast<Inner *>(leftNode)->children);
+      leftNode->setSize(count);
+      int parentCount = parent->size();
+      copyAtomics(parent->keys + left + 1, parent->keys + parentCount, parent->keys + left);
+      copyAtomics(parent->children + left + 2, parent->children + parentCount + 1, parent->children + left + 1);
+      parent->setSize(parentCount - 1);
+      return true;
+    }
+
+    int half = count / 2;
+    storeAtomics(keys, keys + half, leftNode->keys);
+    leftNode->setSize(half);
+    parent->setKey(left, keys[half]);
+    if (leftNode->leaf)
+    {
+      storeAtomics(keys + half, keys + count, rightNode->keys);
+      rightNode->setSize(count - half);
+    }
+    else
+    {
+      storeAtomics(keys + half + 1, keys + count, rightNode->keys);
+      rightNode->setSize(count - half - 1);
+      storeAtomics(children, children + half + 1, static_cast<Inner *>(leftNode)->children);
+      storeAtomics(children + half + 1, children + childCount, static_cast<Inner *>(rightNode)->children);
+    }
+    return false;
+  }
+
+  // Queues a node that is no longer reachable from the root. A thread that
+  // announced a later epoch started after the node left the tree, so the node
+  // can be freed once every announced epoch is later than the one it got.
+  void retire(Node *node)
+  {
+    uint64_t epoch = globalEpoch.fetch_add(1);
+    std::lock_guard<std::mutex> lock(retiredMutex);
+    retired.push_back({epoch, node});
+    if (retired.size() < RECLAIM_BATCH)
+      return;
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    {
+      std::lock_guard<std::mutex> slotLock(slotMutex);
+      for (const auto &slot : slots)
+      {
+        uint64_t announced = slot.second->epoch.load(std::memory_order_acquire);
+        if (announced != 0)
+          oldest = std::min(oldest, announced);
+      }
+    }
+    auto kept = std::partition(retired.begin(), retired.end(),
+                               [oldest](const Retired &entry) { return entry.epoch >= oldest; });
+    for (auto entry = kept; entry != retired.end(); ++entry)
+      free(entry->node);
+    retired.erase(kept, retired.end());
+  }
+
+  static void free(Node *node)
+  {
+    if (node->leaf)
+      delete node;
+    else
+      delete static_cast<Inner *>(node);
+  }
+
+  static void destroy(Node *node)
+  {
+    if (!node->leaf)
+    {
+      Inner *inner = static_cast<Inner *>(node);
+      for (int i = 0; i <= inner->size(); i++)
+        destroy(inner->child(i));
+    }
+    free(node);
+  }
+
+  static void collect(const Node *node, std::vector<T> &out)
+  {
+    if (node->leaf)
+    {
+      for (int i = 0; i < node->size(); i++)
+        out.push_back(node->key(i));
+      return;
+    }
+    const Inner *inner = static_cast<const Inner *>(node);
+    for (int i = 0; i <= inner->size(); i++)
+      collect(inner->child(i), out);
+  }
+};
+
+#endif
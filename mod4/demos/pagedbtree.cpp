@@ -0,0 +1,99 @@
+// Builds a disk-resident B-tree from pagedbtree.h, reopens it and checks it against a sorted array
+// Build: g++ -std=c++17 -O2 pagedbtree.cpp
+// Usage: pagedbtree [file, default btree.pages] [number of keys, default 1e6] [pool pages, default 1024]
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "pagedbtree.h"
+
+// Runs work and prints ns per operation
+template <typename Work>
+void timed(const std::string &name, size_t operations, Work work)
+{
+  auto start = std::chrono::steady_clock::now();
+  work();
+  auto stop = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(stop - start).count() / operations;
+  std::cout << name << ": " << ns << " ns/op" << std::endl;
+}
+
+// Prints what the buffer pool read and wrote
+void printIo(const BufferPool &pool)
+{
+  std::cout << "  " << pool.pageFaults() << " pages read, " << pool.pageWrites() << " pages written" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+  try
+  {
+    std::string filename = argc > 1 ? argv[1] : "btree.pages";
+    size_t n = argc > 2 ? static_cast<size_t>(std::stod(argv[2])) : 1000000;
+    size_t poolPages = argc > 3 ? static_cast<size_t>(std::stod(argv[3])) : 1024;
+
+    std::mt19937 rng(42);
+    std::vector<int> keys(n);
+    for (auto &key : keys)
+      key = rng() % (4 * n + 1);
+    std::vector<int> sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+    bool same = true;
+
+    std::remove(filename.c_str());
+    {
+      PagedBTree<int> tree(filename, poolPages);
+      timed("Insert", n, [&] {
+        for (int key : keys)
+          tree.insert(key);
+        tree.flush();
+      });
+      std::cout << tree.size() << " keys, height " << tree.height() << ", " << tree.MAX_KEYS << " keys per page"
+                << std::endl;
+      printIo(tree.bufferPool());
+    }
+
+    // Reopening reads only the metadata; lookups fault in the pages they reach
+    {
+      PagedBTree<int> tree(filename, poolPages);
+      size_t hits = 0, expected = 0;
+      timed("Lookup after reopening", n, [&] {
+        for (size_t i = 0; i < n; i++)
+          hits += tree.contains(keys[i] + i % 2);
+      });
+      for (size_t i = 0; i < n; i++)
+        expected += std::binary_search(sorted.begin(), sorted.end(), keys[i] + static_cast<int>(i % 2));
+      printIo(tree.bufferPool());
+
+      std::vector<int> range;
+      tree.scan(static_cast<int>(n), static_cast<int>(2 * n), [&](int key) { range.push_back(key); });
+      same = hits == expected && tree.size() == sorted.size() &&
+             std::equal(range.begin(), range.end(), std::lower_bound(sorted.begin(), sorted.end(), n),
+                        std::lower_bound(sorted.begin(), sorted.end(), 2 * n));
+
+      timed("Remove every other key", n / 2, [&] {
+        for (size_t i = 0; i < sorted.size(); i += 2)
+          same = tree.remove(sorted[i]) && same;
+        tree.flush();
+      });
+      printIo(tree.bufferPool());
+    }
+
+    // The removals are on disk too
+    PagedBTree<int> tree(filename, poolPages);
+    same = same && tree.size() == sorted.size() / 2;
+    for (size_t i = 0; i < sorted.size(); i++)
+      same = same && tree.contains(sorted[i]) == (i % 2 == 1);
+    std::cout << (same ? "Paged B-tree and sorted keys agree" : "Wrong answers") << std::endl;
+    return same ? 0 : 1;
+  }
+  catch (const std::exception &e)
+  {
+    std::cerr << "Exception: " << e.what() << std::endl;
+    return 1;
+  }
+}
@@ -0,0 +1,799 @@
+#ifndef PAGEDBTREE_H
+#define PAGEDBTREE_H
+
+// Disk-resident B-tree of keys. The algorithm is the one of BTree in btree.h
+// (full nodes are split and thin nodes filled on the way down, so an operation
+// makes one pass from the root), but every node is one fixed-size page of a
+// file instead of a heap object, so the tree can be far larger than RAM.
+// - page 0 holds the metadata: root, page count, free list, size and height
+// - a node page holds a header, up to 2t - 1 keys and 2t child page numbers,
+//   with t as large as PageBytes allows
+// - pages are reached through a BufferPool of a fixed number of frames with
+//   CLOCK replacement; dirty pages are written back in batches sorted by page
+//   number, so neighbouring pages go out in one pwritev
+// - opening an existing file reads only the metadata; nodes are faulted in as
+//   operations reach them
+// flush() makes the file consistent; there is no log, so a crash between
+// flushes can leave the file in an inconsistent state.
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+const size_t PAGED_WRITE_BATCH = 64; // dirty pages written back together
+const size_t PAGED_MIN_FRAMES = 16;  // enough for a root-to-leaf path and a split or merge
+
+// Caches the pages of a file in memory frames. A page is pinned while used
+// and cannot be evicted until unpinned; a PageRef unpins when it goes away.
+class BufferPool
+{
+  struct Frame
+  {
+    uint64_t page = 0;
+    int pins = 0;
+    bool used = false, referenced = false, dirty = false;
+  };
+
+public:
+  class PageRef
+  {
+  public:
+    PageRef() = default;
+    PageRef(BufferPool *pool, size_t frame) : pool(pool), frame(frame) {}
+
+    PageRef(PageRef &&other) noexcept : pool(other.pool), frame(other.frame)
+    {
+      other.pool = nullptr;
+    }
+
+    PageRef &operator=(PageRef &&other) noexcept
+    {
+      if (this != &other)
+      {
+        release();
+        pool = other.pool;
+        frame = other.frame;
+        other.pool = nullptr;
+      }
+      return *this;
+    }
+
+    ~PageRef()
+    {
+      release();
+    }
+
+    uint64_t page() const
+    {
+      return pool->frames[frame].page;
+    }
+
+    char *data() const
+    {
+      return pool->memory + frame * pool->pageBytes;
+    }
+
+    void markDirty()
+    {
+      pool->frames[frame].dirty = true;
+    }
+
+  private:
+    BufferPool *pool = nullptr;
+    size_t frame = 0;
+
+    void release()
+    {
+      if (pool != nullptr)
+        pool->frames[frame].pins--;
+      pool = nullptr;
+    }
+  };
+
+  // Opens or creates filename with frameCount frames of pageBytes
+  BufferPool(const std::string &filename, size_t pageBytes, size_t frameCount)
+      : filename(filename), pageBytes(pageBytes), frames(std::max(frameCount, PAGED_MIN_FRAMES))
+  {
+    fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+      throwError("Error opening");
+    }
+    struct stat info;
+    if (::fstat(fd, &info) != 0)
+    {
+      ::close(fd);
+      throwError("Error reading the size of");
+    }
+    filePages = info.st_size / pageBytes;
+    // The pool does the caching, so read-ahead of the kernel would only waste I/O
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    memory = static_cast<char *>(std::aligned_alloc(4096, (frames.size() * pageBytes + 4095) / 4096 * 4096));
+    if (memory == nullptr)
+    {
+      ::close(fd);
+      throw std::bad_alloc();
+    }
+  }
+
+  BufferPool(const BufferPool &) = delete;
+  BufferPool &operator=(const BufferPool &) = delete;
+
+  ~BufferPool()
+  {
+    try
+    {
+      flush();
+    }
+    catch (...)
+    {
+      // Call flush() to see write errors
+    }
+    std::free(memory);
+    ::close(fd);
+  }
+
+  // Pages in the file when it was opened
+  uint64_t pagesOnDisk() const
+  {
+    return filePages;
+  }
+
+  // Pins a page, reading it from the file if it is not cached
+  PageRef pin(uint64_t page)
+  {
+    auto found = table.find(page);
+    if (found != table.end())
+    {
+      Frame &frame = frames[found->second];
+      frame.pins++;
+      frame.referenced = true;
+      return PageRef(this, found->second);
+    }
+    size_t frame = load(page);
+    try
+    {
+      readPage(page, memory + frame * pageBytes);
+    }
+    catch (...)
+    {
+      table.erase(page);
+      frames[frame] = Frame();
+      throw;
+    }
+    faults++;
+    return PageRef(this, frame);
+  }
+
+  // Pins a zeroed page that is not in the file yet, or whose content is dropped
+  PageRef pinNew(uint64_t page)
+  {
+    auto found = table.find(page);
+    size_t frame = found != table.end() ? found->second : load(page);
+    if (found != table.end())
+    {
+      frames[frame].pins++;
+      frames[frame].referenced = true;
+    }
+    std::memset(memory + frame * pageBytes, 0, pageBytes);
+    frames[frame].dirty = true;
+    return PageRef(this, frame);
+  }
+
+  // Writes all dirty pages and syncs the file
+  void flush()
+  {
+    std::vector<size_t> dirty;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+      if (frames[i].used && frames[i].dirty)
+        dirty.push_back(i);
+    }
+    writeBack(dirty);
+    if (::fsync(fd) != 0)
+    {
+      throwError("Error syncing");
+    }
+  }
+
+  // Pages read from and written to the file
+  unsigned long long pageFaults() const
+  {
+    return faults;
+  }
+
+  unsigned long long pageWrites() const
+  {
+    return writes;
+  }
+
+private:
+  std::string filename;
+  size_t pageBytes;
+  int fd = -1;
+  char *memory = nullptr;
+  std::vector<Frame> frames;
+  std::unordered_map<uint64_t, size_t> table; // page -> frame
+  size_t hand = 0;                            // clock hand
+  uint64_t filePages = 0;
+  unsigned long long faults = 0, writes = 0;
+
+  [[noreturn]] void throwError(const std::string &what) const
+  {
+    throw std::runtime_error(what + " " + filename + ": " + std::strerror(errno));
+  }
+
+  // Finds a frame for page, evicting another page if needed, and pins it
+  size_t load(uint64_t page)
+  {
+    size_t frame = victim();
+    if (frames[frame].used)
+    {
+      table.erase(frames[frame].page);
+    }
+    frames[frame] = Frame{page, 1, true, true, false};
+    table[page] = frame;
+    return frame;
+  }
+
+  // CLOCK: sweeps the frames, giving referenced pages a second chance. A dirty
+  // victim is written back together with the dirty pages the hand reaches next.
+  size_t victim()
+  {
+    for (size_t step = 0; step < 2 * frames.size() + 1; step++)
+    {
+      size_t frame = hand;
+      hand = (hand + 1) % frames.size();
+      Frame &candidate = frames[frame];
+      if (!candidate.used)
+        return frame;
+      if (candidate.pins > 0)
+        continue;
+      if (candidate.referenced)
+      {
+        candidate.referenced = false;
+        continue;
+      }
+      if (candidate.dirty)
+      {
+        std::vector<size_t> batch{frame};
+        for (size_t i = 1; i < frames.size() && batch.size() < PAGED_WRITE_BATCH; i++)
+        {
+          size_t next = (frame + i) % frames.size();
+          if (frames[next].used && frames[next].dirty && frames[next].pins == 0)
+            batch.push_back(next);
+        }
+        writeBack(batch);
+      }
+      return frame;
+    }
+    throw std::runtime_error("All frames of the buffer pool for " + filename + " are pinned");
+  }
+
+  // Writes the pages of the frames in page order, one pwritev per run of consecutive pages
+  void writeBack(std::vector<size_t> &batch)
+  {
+    std::sort(batch.begin(), batch.end(), [&](size_t a, size_t b) { return frames[a].page < frames[b].page; });
+    for (size_t first = 0; first < batch.size();)
+    {
+      size_t last = first + 1;
+      while (last < batch.size() && last - first < IOV_MAX &&
+             frames[batch[last]].page == frames[batch[last - 1]].page + 1)
+      {
+        last++;
+      }
+      std::vector<iovec> pages(last - first);
+      for (size_t i = first; i < last; i++)
+      {
+        pages[i - first] = {memory + batch[i] * pageBytes, pageBytes};
+      }
+      uint64_t page = frames[batch[first]].page;
+      ssize_t put = ::pwritev(fd, pages.data(), pages.size(), page * pageBytes);
+      if (put != static_cast<ssize_t>(pages.size() * pageBytes))
+      {
+        // Short or interrupted: finish page by page
+        for (size_t i = first; i < last; i++)
+          writePage(frames[batch[i]].page, memory + batch[i] * pageBytes);
+      }
+      for (size_t i = first; i < last; i++)
+      {
+        frames[batch[i]].dirty = false;
+        filePages = std::max(filePages, frames[batch[i]].page + 1);
+      }
+      writes += last - first;
+      first = last;
+    }
+  }
+
+  void writePage(uint64_t page, const char *bytes)
+  {
+    for (size_t done = 0; done < pageBytes;)
+    {
+      ssize_t put = ::pwrite(fd, bytes + done, pageBytes - done, page * pageBytes + done);
+      if (put < 0 && errno == EINTR)
+        continue;
+      if (put <= 0)
+      {
+        throwError("Error writing");
+      }
+      done += put;
+    }
+  }
+
+  void readPage(uint64_t page, char *bytes)
+  {
+    for (size_t done = 0; done < pageBytes;)
+    {
+      ssize_t got = ::pread(fd, bytes + done, pageBytes - done, page * pageBytes + done);
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got < 0)
+      {
+        throwError("Error reading");
+      }
+      if (got == 0)
+      {
+        throw std::runtime_error("Page " + std::to_string(page) + " is past the end of " + filename);
+      }
+      done += got;
+    }
+  }
+};
+
+template <typename T, size_t PageBytes = 4096>
+class PagedBTree
+{
+  static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= 8, "keys are stored inline in the pages");
+
+  static constexpr size_t HEADER_BYTES = 8; // leaf flag and key count
+
+  static constexpr size_t childrenOffset(size_t t)
+  {
+    return (HEADER_BYTES + (2 * t - 1) * sizeof(T) + 7) / 8 * 8;
+  }
+
+  // The largest minimum degree whose node fits a page
+  static constexpr size_t degree()
+  {
+    size_t t = 2;
+    while (childrenOffset(t + 1) + 2 * (t + 1) * sizeof(uint64_t) <= PageBytes)
+      t++;
+    return t;
+  }
+
+public:
+  static constexpr size_t t = degree();
+  static constexpr size_t MAX_KEYS = 2 * t - 1;
+  static_assert(childrenOffset(t) + 2 * t * sizeof(uint64_t) <= PageBytes, "a page must hold at least 3 keys");
+
+  // Opens the tree in filename, or creates it if the file is empty, caching
+  // up to poolPages pages in memory
+  PagedBTree(const std::string &filename, size_t poolPages = 1024) : pool(filename, PageBytes, poolPages)
+  {
+    if (pool.pagesOnDisk() == 0)
+    {
+      meta = Meta{MAGIC, PageBytes, sizeof(T), 0, 1, 0, 0, 1};
+      pool.pinNew(0);
+      Node root = allocate(true);
+      meta.root = root.id();
+      return;
+    }
+    BufferPool::PageRef page = pool.pin(0);
+    std::memcpy(&meta, page.data(), sizeof(Meta));
+    if (meta.magic != MAGIC || meta.pageBytes != PageBytes || meta.keyBytes != sizeof(T))
+    {
+      throw std::runtime_error(filename + " is not a B-tree with pages of " + std::to_string(PageBytes) +
+                               " bytes and keys of " + std::to_string(sizeof(T)) + " bytes");
+    }
+  }
+
+  ~PagedBTree()
+  {
+    try
+    {
+      flush();
+    }
+    catch (...)
+    {
+      // Call flush() to see write errors
+    }
+  }
+
+  // Writes the metadata and all dirty pages to the file
+  void flush()
+  {
+    BufferPool::PageRef page = pool.pin(0);
+    std::memcpy(page.data(), &meta, sizeof(Meta));
+    page.markDirty();
+    pool.flush();
+  }
+
+  bool contains(const T &key)
+  {
+    Node node = fetch(meta.root);
+    while (true)
+    {
+      size_t i = lowerBound(node, key);
+      if (i < node.count() && !(key < node.keys()[i]))
+        return true;
+      if (node.leaf())
+        return false;
+      node = fetch(node.children()[i]);
+    }
+  }
+
+  // Adds key; returns false if it is already in the tree
+  bool insert(const T &key)
+  {
+    Node node = fetch(meta.root);
+    if (node.count() == MAX_KEYS)
+    {
+      Node newRoot = allocate(false);
+      newRoot.children()[0] = node.id();
+      splitChild(newRoot, 0, node);
+      meta.root = newRoot.id();
+      meta.height++;
+      node = std::move(newRoot);
+    }
+
+    while (true)
+    {
+      size_t i = lowerBound(node, key);
+      if (i < node.count() && !(key < node.keys()[i]))
+        return false;
+      if (node.leaf())
+      {
+        T *keys = node.keys();
+        std::copy_backward(keys + i, keys + node.count(), keys + node.count() + 1);
+        keys[i] = key;
+        node.setCount(node.count() + 1);
+        meta.size++;
+        return true;
+      }
+      Node child = fetch(node.children()[i]);
+      if (child.count() == MAX_KEYS)
+      {
+        splitChild(node, i, child);
+        if (node.keys()[i] < key)
+          child = fetch(node.children()[i + 1]);
+        else if (!(key < node.keys()[i]))
+          return false;
+      }
+      node = std::move(child);
+    }
+  }
+
+  // Removes key; returns false if it is not in the tree
+  bool remove(const T &key)
+  {
+    bool removed = false;
+    T target = key;
+    Node node = fetch(meta.root);
+    while (true)
+    {
+      size_t i = lowerBound(node, target);
+      bool found = i < node.count() && !(target < node.keys()[i]);
+      if (node.leaf())
+      {
+        if (found)
+        {
+          T *keys = node.keys();
+          std::copy(keys + i + 1, keys + node.count(), keys + i);
+          node.setCount(node.count() - 1);
+          removed = true;
+        }
+        break;
+      }
+
+      if (found)
+      {
+        // Replace the key by its predecessor or successor and remove that from
+        // the child it comes from, or merge the children around the key
+        Node left = fetch(node.children()[i]);
+        if (left.count() >= t)
+        {
+          target = extreme(left, true);
+          node.keys()[i] = target;
+          node.markDirty();
+          node = std::move(left);
+          continue;
+        }
+        Node right = fetch(node.children()[i + 1]);
+        if (right.count() >= t)
+        {
+          target = extreme(right, false);
+          node.keys()[i] = target;
+          node.markDirty();
+          node = std::move(right);
+          continue;
+        }
+        merge(node, i, left, right);
+        node = std::move(left);
+        continue;
+      }
+
+      // Make sure the child to go down to has a key to spare
+      Node child = fetch(node.children()[i]);
+      if (child.count() < t)
+        child = fill(node, i, std::move(child));
+      node = std::move(child);
+    }
+
+    Node root = fetch(meta.root);
+    if (root.count() == 0 && !root.leaf())
+    {
+      meta.root = root.children()[0];
+      meta.height--;
+      release(std::move(root));
+    }
+    if (removed)
+      meta.size--;
+    return removed;
+  }
+
+  // Calls visit(key) for the keys in [lo, hi) in order
+  template <typename Visit>
+  void scan(const T &lo, const T &hi, Visit visit)
+  {
+    scan(meta.root, lo, hi, visit);
+  }
+
+  unsigned long long size() const
+  {
+    return meta.size;
+  }
+
+  unsigned height() const
+  {
+    return meta.height;
+  }
+
+  const BufferPool &bufferPool() const
+  {
+    return pool;
+  }
+
+private:
+  static constexpr uint64_t MAGIC = 0x3130454552544250ULL; // "PBTREE01"
+
+  struct Meta
+  {
+    uint64_t magic, pageBytes, keyBytes;
+    uint64_t root, pages, freeList; // freeList: first free page, 0 if none
+    uint64_t size, height;
+  };
+
+  // A pinned node page
+  class Node
+  {
+  public:
+    Node(BufferPool::PageRef page) : page(std::move(page)) {}
+
+    uint64_t id() const
+    {
+      return page.page();
+    }
+
+    bool leaf() const
+    {
+      return header()[0] != 0;
+    }
+
+    void setLeaf(bool leaf)
+    {
+      header()[0] = leaf;
+      page.markDirty();
+    }
+
+    size_t count() const
+    {
+      return header()[1];
+    }
+
+    void setCount(size_t count)
+    {
+      header()[1] = static_cast<uint32_t>(count);
+      page.markDirty();
+    }
+
+    // Callers that change keys or children mark the page dirty
+    T *keys() const
+    {
+      return reinterpret_cast<T *>(page.data() + HEADER_BYTES);
+    }
+
+    uint64_t *children() const
+    {
+      return reinterpret_cast<uint64_t *>(page.data() + childrenOffset(t));
+    }
+
+    void markDirty()
+    {
+      page.markDirty();
+    }
+
+    char *data() const
+    {
+      return page.data();
+    }
+
+  private:
+    BufferPool::PageRef page;
+
+    uint32_t *header() const
+    {
+      return reinterpret_cast<uint32_t *>(page.data());
+    }
+  };
+
+  BufferPool pool;
+  Meta meta;
+
+  Node fetch(uint64_t id)
+  {
+    return Node(pool.pin(id));
+  }
+
+  // Takes a page from the free list, or a new one at the end of the file
+  Node allocate(bool leaf)
+  {
+    uint64_t id = meta.freeList;
+    if (id != 0)
+    {
+      BufferPool::PageRef free = pool.pin(id);
+      std::memcpy(&meta.freeList, free.data(), sizeof(uint64_t));
+    }
+    else
+    {
+      id = meta.pages++;
+    }
+    Node node(pool.pinNew(id));
+    node.setLeaf(leaf);
+    return node;
+  }
+
+  // Puts the page of node on the free list
+  void release(Node node)
+  {
+    std::memcpy(node.data(), &meta.freeList, sizeof(uint64_t));
+    node.markDirty();
+    meta.freeList = node.id();
+  }
+
+  static size_t lowerBound(const Node &node, const T &key)
+  {
+    return std::lower_bound(node.keys(), node.keys() + node.count(), key) - node.keys();
+  }
+
+  // Largest (or smallest) key under node
+  T extreme(const Node &node, bool largest)
+  {
+    if (node.leaf())
+      return node.keys()[largest ? node.count() - 1 : 0];
+    Node child = fetch(node.children()[largest ? node.count() : 0]);
+    while (!child.leaf())
+      child = fetch(child.children()[largest ? child.count() : 0]);
+    return child.keys()[largest ? child.count() - 1 : 0];
+  }
+
+  // Moves the upper half of the full child i of parent to a new sibling
+  void splitChild(Node &parent, size_t i, Node &child)
+  {
+    Node sibling = allocate(child.leaf());
+    std::copy(child.keys() + t, child.keys() + MAX_KEYS, sibling.keys());
+    if (!child.leaf())
+      std::copy(child.children() + t, child.children() + 2 * t, sibling.children());
+    sibling.setCount(t - 1);
+    child.setCount(t - 1);
+
+    size_t n = parent.count();
+    std::copy_backward(parent.keys() + i, parent.keys() + n, parent.keys() + n + 1);
+    std::copy_backward(parent.children() + i + 1, parent.children() + n + 1, parent.children() + n + 2);
+    parent.keys()[i] = child.keys()[t - 1];
+    parent.children()[i + 1] = sibling.id();
+    parent.setCount(n + 1);
+  }
+
+  // Moves key i of parent and all of right into left, and frees right
+  void merge(Node &parent, size_t i, Node &left, Node &right)
+  {
+    size_t n = left.count();
+    left.keys()[n] = parent.keys()[i];
+    std::copy(right.keys(), right.keys() + right.count(), left.keys() + n + 1);
+    if (!left.leaf())
+      std::copy(right.children(), right.children() + right.count() + 1, left.children() + n + 1);
+    left.setCount(n + 1 + right.count());
+
+    size_t m = parent.count();
+    std::copy(parent.keys() + i + 1, parent.keys() + m, parent.keys() + i);
+    std::copy(parent.children() + i + 2, parent.children() + m + 1, parent.children() + i + 1);
+    parent.setCount(m - 1);
+    release(std::move(right));
+  }
+
+  // Gives child i of parent, which has t - 1 keys, another key from a sibling,
+  // or merges it with one; returns the node that holds its keys now
+  Node fill(Node &parent, size_t i, Node child)
+  {
+    if (i > 0)
+    {
+      Node left = fetch(parent.children()[i - 1]);
+      if (left.count() >= t)
+      {
+        // Rotate the last key of left through the parent
+        std::copy_backward(child.keys(), child.keys() + child.count(), child.keys() + child.count() + 1);
+        child.keys()[0] = parent.keys()[i - 1];
+        if (!child.leaf())
+        {
+          std::copy_backward(child.children(), child.children() + child.count() + 1,
+                             child.children() + child.count() + 2);
+          child.children()[0] = left.children()[left.count()];
+        }
+        parent.keys()[i - 1] = left.keys()[left.count() - 1];
+        parent.markDirty();
+        child.setCount(child.count() + 1);
+        left.setCount(left.count() - 1);
+        return child;
+      }
+    }
+    if (i < parent.count())
+    {
+      Node right = fetch(parent.children()[i + 1]);
+      if (right.count() >= t)
+      {
+        // Rotate the first key of right through the parent
+        child.keys()[child.count()] = parent.keys()[i];
+        if (!child.leaf())
+          child.children()[child.count() + 1] = right.children()[0];
+        parent.keys()[i] = right.keys()[0];
+        parent.markDirty();
+        std::copy(right.keys() + 1, right.keys() + right.count(), right.keys());
+        if (!right.leaf())
+          std::copy(right.children() + 1, right.children() + right.count() + 1, right.children());
+        child.setCount(child.count() + 1);
+        right.setCount(right.count() - 1);
+        return child;
+      }
+      merge(parent, i, child, right);
+      return child;
+    }
+    Node left = fetch(parent.children()[i - 1]);
+    merge(parent, i - 1, left, child);
+    return left;
+  }
+
+  // In-order walk of the subtree of page id; returns false once a key reaches hi
+  template <typename Visit>
+  bool scan(uint64_t id, const T &lo, const T &hi, Visit &visit)
+  {
+    Node node = fetch(id);
+    for (size_t i = lowerBound(node, lo);; i++)
+    {
+      if (!node.leaf() && !scan(node.children()[i], lo, hi, visit))
+        return false;
+      if (i == node.count())
+        return true;
+      if (!(node.keys()[i] < hi))
+        return false;
+      visit(node.keys()[i]);
+    }
+  }
+};
+
+#endif
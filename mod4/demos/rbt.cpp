@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstddef>
+#include <iterator>
 #include <queue>
 
 template <typename T>
@@ -390,6 +392,182 @@ public:
     levelOrderHelper(root);
     std::cout << std::endl;
   }
+
+  // Bidirectional iterator over the keys in order, following the parent
+  // pointers: no recursion and no stack
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    const_iterator() = default;
+
+    reference operator*() const
+    {
+      return node->data;
+    }
+
+    pointer operator->() const
+    {
+      return &node->data;
+    }
+
+    const_iterator &operator++()
+    {
+      if (node->right != nullptr)
+      {
+        // The leftmost node of the right subtree
+        node = node->right;
+        while (node->left != nullptr)
+          node = node->left;
+      }
+      else
+      {
+        // The first ancestor reached from its left subtree
+        const Node *child = node;
+        node = node->parent;
+        while (node != nullptr && child == node->right)
+        {
+          child = node;
+          node = node->parent;
+        }
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    const_iterator &operator--()
+    {
+      if (node == nullptr)
+      {
+        // From the end: the rightmost node of the tree
+        node = tree->root;
+        while (node->right != nullptr)
+          node = node->right;
+      }
+      else if (node->left != nullptr)
+      {
+        node = node->left;
+        while (node->right != nullptr)
+          node = node->right;
+      }
+      else
+      {
+        const Node *child = node;
+        node = node->parent;
+        while (node != nullptr && child == node->left)
+        {
+          child = node;
+          node = node->parent;
+        }
+      }
+      return *this;
+    }
+
+    const_iterator operator--(int)
+    {
+      const_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator &other) const
+    {
+      return node == other.node;
+    }
+
+    bool operator!=(const const_iterator &other) const
+    {
+      return node != other.node;
+    }
+
+  private:
+    friend class RedBlackTree;
+    const RedBlackTree *tree = nullptr;
+    const Node *node = nullptr; // nullptr at the end
+
+    const_iterator(const RedBlackTree *tree, const Node *node) : tree(tree), node(node) {}
+  };
+
+  using iterator = const_iterator;
+
+  // The keys in [lo, hi), produced lazily as the range is iterated
+  struct Range
+  {
+    const_iterator first, last;
+
+    const_iterator begin() const
+    {
+      return first;
+    }
+
+    const_iterator end() const
+    {
+      return last;
+    }
+  };
+
+  const_iterator begin() const
+  {
+    const Node *node = root;
+    while (node != nullptr && node->left != nullptr)
+      node = node->left;
+    return const_iterator(this, node);
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(this, nullptr);
+  }
+
+  // First key not less than key
+  const_iterator lower_bound(const T &key) const
+  {
+    const Node *result = nullptr;
+    for (const Node *node = root; node != nullptr;)
+    {
+      if (node->data < key)
+        node = node->right;
+      else
+      {
+        result = node;
+        node = node->left;
+      }
+    }
+    return const_iterator(this, result);
+  }
+
+  // First key greater than key
+  const_iterator upper_bound(const T &key) const
+  {
+    const Node *result = nullptr;
+    for (const Node *node = root; node != nullptr;)
+    {
+      if (key < node->data)
+      {
+        result = node;
+        node = node->left;
+      }
+      else
+        node = node->right;
+    }
+    return const_iterator(this, result);
+  }
+
+  Range range(const T &lo, const T &hi) const
+  {
+    return {lower_bound(lo), lower_bound(hi)};
+  }
 };
 
 int main()
@@ -419,5 +597,19 @@ int main()
   std::cout << "In-order traversal after deleting 40: ";
   tree.inorder();
 
+  std::cout << "Keys in [20, 40): ";
+  for (int key : tree.range(20, 40))
+  {
+    std::cout << key << " ";
+  }
+  std::cout << std::endl;
+
+  std::cout << "Keys in reverse: ";
+  for (auto it = tree.end(); it != tree.begin();)
+  {
+    std::cout << *--it << " ";
+  }
+  std::cout << std::endl;
+
   return 0;
 }
@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <queue>
 
 template <typename T>
@@ -233,6 +235,201 @@ public:
     }
     std::cout << std::endl;
   }
+
+  // Bidirectional iterator over the keys in order. It moves along the parent
+  // pointers, so it needs neither recursion nor a stack.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T *;
+    using reference = const T &;
+
+    const_iterator() = default;
+
+    reference operator*() const
+    {
+      return node->keys[index];
+    }
+
+    pointer operator->() const
+    {
+      return &node->keys[index];
+    }
+
+    const_iterator &operator++()
+    {
+      if (!node->isLeaf())
+      {
+        // The successor is the first key of the leftmost leaf of the right subtree
+        node = node->children[index + 1];
+        while (!node->isLeaf())
+          node = node->children.front();
+        index = 0;
+      }
+      else
+      {
+        index++;
+      }
+      climbToNext();
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      const_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    const_iterator &operator--()
+    {
+      if (node == nullptr || !node->isLeaf())
+      {
+        // The predecessor is the last key of the rightmost leaf of the left
+        // subtree; from the end, of the whole tree
+        node = node == nullptr ? tree->root : node->children[index];
+        while (!node->isLeaf())
+          node = node->children.back();
+        index = node->keys.size();
+      }
+      if (index > 0)
+      {
+        index--;
+        return *this;
+      }
+      // Up to the first ancestor that has a key before this subtree
+      while (node->parent != nullptr)
+      {
+        size_t child = childIndex();
+        node = node->parent;
+        if (child > 0)
+        {
+          index = child - 1;
+          return *this;
+        }
+      }
+      node = nullptr;
+      return *this;
+    }
+
+    const_iterator operator--(int)
+    {
+      const_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    bool operator==(const const_iterator &other) const
+    {
+      return node == other.node && index == other.index;
+    }
+
+    bool operator!=(const const_iterator &other) const
+    {
+      return !(*this == other);
+    }
+
+  private:
+    friend class TwoFourTree;
+    const TwoFourTree *tree = nullptr;
+    const Node *node = nullptr; // nullptr at the end
+    size_t index = 0;
+
+    const_iterator(const TwoFourTree *tree, const Node *node, size_t index) : tree(tree), node(node), index(index) {}
+
+    size_t childIndex() const
+    {
+      const auto &siblings = node->parent->children;
+      return std::find(siblings.begin(), siblings.end(), node) - siblings.begin();
+    }
+
+    // Past the last key of a node: up to the first ancestor with a key after this subtree
+    void climbToNext()
+    {
+      while (index >= node->keys.size())
+      {
+        if (node->parent == nullptr)
+        {
+          node = nullptr;
+          index = 0;
+          return;
+        }
+        index = childIndex();
+        node = node->parent;
+      }
+    }
+  };
+
+  using iterator = const_iterator;
+
+  // The keys in [lo, hi), produced lazily as the range is iterated
+  struct Range
+  {
+    const_iterator first, last;
+
+    const_iterator begin() const
+    {
+      return first;
+    }
+
+    const_iterator end() const
+    {
+      return last;
+    }
+  };
+
+  const_iterator begin() const
+  {
+    const Node *node = root;
+    while (!node->isLeaf())
+      node = node->children.front();
+    const_iterator it(this, node, 0);
+    it.climbToNext();
+    return it;
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(this, nullptr, 0);
+  }
+
+  // First key not less than key
+  const_iterator lower_bound(const T &key) const
+  {
+    return bound(key, false);
+  }
+
+  // First key greater than key
+  const_iterator upper_bound(const T &key) const
+  {
+    return bound(key, true);
+  }
+
+  Range range(const T &lo, const T &hi) const
+  {
+    return {lower_bound(lo), lower_bound(hi)};
+  }
+
+private:
+  // The last node on the way down from the root with a bounding key: the
+  // subtree left of that key holds no key within the bound
+  const_iterator bound(const T &key, bool upper) const
+  {
+    const_iterator result = end();
+    for (const Node *node = root; node != nullptr;)
+    {
+      auto it = upper ? std::upper_bound(node->keys.begin(), node->keys.end(), key)
+                      : std::lower_bound(node->keys.begin(), node->keys.end(), key);
+      size_t i = it - node->keys.begin();
+      if (i < node->keys.size())
+        result = const_iterator(this, node, i);
+      node = node->isLeaf() ? nullptr : node->children[i];
+    }
+    return result;
+  }
 };
 
 int main()
@@ -267,5 +464,19 @@ int main()
   std::cout << "Level-order Traversal: ";
   tree.levelOrderTraversal();
 
+  std::cout << "Keys in [8, 25): ";
+  for (int key : tree.range(8, 25))
+  {
+    std::cout << key << " ";
+  }
+  std::cout << std::endl;
+
+  std::cout << "Keys in reverse: ";
+  for (auto it = tree.end(); it != tree.begin();)
+  {
+    std::cout << *--it << " ";
+  }
+  std::cout << std::endl;
+
   return 0;
 }